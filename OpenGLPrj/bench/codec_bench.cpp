@@ -0,0 +1,88 @@
+#include "heightfield_codec.hpp"
+#include "noise.hpp"
+#include "tile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <thread>
+#include <vector>
+
+// Size reduction the codec must reach at HEIGHTFIELD_DEFAULT_TOLERANCE.
+static const double MIN_DEFAULT_RATIO = 8.0;
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Best of several runs; a single decode is short enough that scheduling
+// noise would otherwise dominate.
+static double best_decode_ms(const Heightfield_Decoder& decoder, std::vector<float>& decoded, int threads) {
+    const int runs = 20;
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < runs; i++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        decoder.decode(decoded, threads);
+        best = std::min(best, elapsed_ms(start));
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    int size = argc > 1 ? atoi(argv[1]) : 1024;
+    int threads = argc > 2 ? atoi(argv[2]) : (int)std::thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+
+    Tile_Params params;
+    params.tile_size = size - 1;
+    params.scale = 64.0f;
+    params.octaves = 6;
+    params.persistence = 0.5f;
+    params.backend = PERLIN_NOISE;
+    std::unique_ptr<NoiseSource> source = make_noise_source(params.backend);
+    Tile tile;
+    generate_tile(*source, params, 0, 0, tile);
+
+    size_t raw_bytes = tile.heights.size() * sizeof(float);
+    printf("heightfield %d x %d, raw %.2f MB, %d decode threads\n", size, size, raw_bytes / 1e6, threads);
+
+    // Tolerances whose quantised range cannot fit must be rejected, not
+    // overflow; the generated field is in [0, 1].
+    float max_abs = 0.0f;
+    for (unsigned int i = 0; i < tile.heights.size(); i++) max_abs = std::max(max_abs, std::fabs(tile.heights[i]));
+    // Decoded heights are quantised values rounded to float once more.
+    float rounding = max_abs * std::numeric_limits<float>::epsilon();
+
+    bool passed = encode_heightfield(&tile.heights[0], size, size, 1e-12f).empty();
+    if (!passed) printf("FAIL: tolerance 1e-12 was not rejected\n");
+
+    float tolerances[] = {1e-4f, 5e-4f, 1e-3f, HEIGHTFIELD_DEFAULT_TOLERANCE, 4e-3f};
+    for (unsigned int t = 0; t < sizeof(tolerances) / sizeof(tolerances[0]); t++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<unsigned char> encoded = encode_heightfield(&tile.heights[0], size, size, tolerances[t]);
+        double encode_ms = elapsed_ms(start);
+
+        Heightfield_Decoder decoder(&encoded[0], encoded.size());
+        std::vector<float> decoded;
+        double decode_ms = best_decode_ms(decoder, decoded, 1);
+        double decode_mt_ms = best_decode_ms(decoder, decoded, threads);
+
+        float error = 0.0f;
+        for (unsigned int i = 0; i < decoded.size(); i++) error = std::max(error, std::fabs(decoded[i] - tile.heights[i]));
+
+        double ratio = (double)raw_bytes / encoded.size();
+        bool within = decoded.size() == tile.heights.size() && error <= tolerances[t] + rounding;
+        bool small_enough = tolerances[t] != HEIGHTFIELD_DEFAULT_TOLERANCE || ratio >= MIN_DEFAULT_RATIO;
+        if (!within || !small_enough) passed = false;
+
+        printf("tolerance %.1e: %8zu bytes, %5.1fx smaller, %.2f bits/sample, max error %.2e%s%s\n",
+               tolerances[t], encoded.size(), ratio, encoded.size() * 8.0 / tile.heights.size(), error,
+               within ? "" : "  FAIL: error above tolerance", small_enough ? "" : "  FAIL: below the 8x target");
+        printf("    encode %7.1f MB/s  decode %7.2f GB/s (1 thread)  %7.2f GB/s (%d threads)\n",
+               raw_bytes / encode_ms / 1e3, raw_bytes / decode_ms / 1e6, raw_bytes / decode_mt_ms / 1e6, threads);
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,209 @@
+#include "perlin.hpp"
+#include "noise.hpp"
+#include "fbm.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <vector>
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Largest accepted difference between a batch and the scalar samples it
+// replaces; the SIMD paths use the scalar operation order, so this is slack
+// for compilers that contract into FMA.
+static const float BATCH_TOLERANCE = 1e-6f;
+
+static float max_difference(const std::vector<float>& a, const std::vector<float>& b) {
+    float error = 0.0f;
+    for (unsigned int i = 0; i < a.size(); i++) error = std::max(error, std::fabs(a[i] - b[i]));
+    return error;
+}
+
+// Times scalar and batched sampling in 2D and 3D and checks that the batches
+// match the scalar results; returns false on a mismatch.
+static bool bench_backend(const NoiseSource& source, int samples) {
+    // An odd count exercises the scalar tail; coordinates straddle zero and
+    // the 256-cell permutation period.
+    samples |= 1;
+    std::vector<float> x(samples), y(samples), z(samples), out(samples), scalar(samples);
+    for (int i = 0; i < samples; i++) {
+        x[i] = (i % 1024) * 0.371f - 190.0f;
+        y[i] = (i / 1024) * 0.371f - 20.0f;
+        z[i] = (i % 97) * 1.13f - 50.0f;
+    }
+
+    float sink = 0.0f;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < samples; i++) scalar[i] = source.sample(x[i], y[i]);
+    double scalar_2d = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    source.sample_batch(&x[0], &y[0], &out[0], samples);
+    double batch_2d = elapsed_ms(start);
+    float error_2d = max_difference(out, scalar);
+    sink += out[samples / 2];
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < samples; i++) scalar[i] = source.sample(x[i], y[i], z[i]);
+    double scalar_3d = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    source.sample_batch(&x[0], &y[0], &z[0], &out[0], samples);
+    double batch_3d = elapsed_ms(start);
+    float error_3d = max_difference(out, scalar);
+    sink += out[samples / 2];
+
+    bool matches = error_2d <= BATCH_TOLERANCE && error_3d <= BATCH_TOLERANCE;
+    printf("%-8s 2D scalar %7.1f  batch %7.1f  |  3D scalar %7.1f  batch %7.1f  Msamples/s  max diff %.1e / %.1e  %s  (%g)\n", source.name(),
+           samples / scalar_2d / 1000.0, samples / batch_2d / 1000.0,
+           samples / scalar_3d / 1000.0, samples / batch_3d / 1000.0, error_2d, error_3d, matches ? "match" : "MISMATCH", sink);
+    return matches;
+}
+
+// Float rounding in the filter and the octave sum, which the bound, derived
+// for exact arithmetic, does not cover.
+static const float SUM_ROUNDING = 1e-6f;
+
+// Octave sum over the whole grid, as Terrain accumulates it before normalising.
+static std::vector<float> fbm_sum(const NoiseSource& source, int size, float scale, int octaves, float persistence, float tolerance, float& range, double& ms) {
+    std::vector<float> sum(size * size, 0.0f);
+    float min_val = std::numeric_limits<float>::max();
+    float max_val = std::numeric_limits<float>::lowest();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    generate_fbm_rows(source, size, size, 0, size, scale, octaves, persistence, tolerance, &sum[0], min_val, max_val);
+    ms = elapsed_ms(start);
+    range = max_val - min_val;
+    return sum;
+}
+
+// Times the exact and multires fBm through the same backend and batch path
+// and checks the measured error of the octave sum against
+// multires_error_bound; returns false if the bound is exceeded.
+static bool bench_multires(const NoiseSource& source, int size, float scale, int octaves, float persistence, float tolerance) {
+    float exact_range = 0.0f, multires_range = 0.0f;
+    double exact_ms = 0.0, multires_ms = 0.0;
+    std::vector<float> exact = fbm_sum(source, size, scale, octaves, persistence, 0.0f, exact_range, exact_ms);
+    std::vector<float> multires = fbm_sum(source, size, scale, octaves, persistence, tolerance, multires_range, multires_ms);
+
+    std::vector<float> spacing = multires_octave_spacings(source, size, size, scale, octaves, persistence, tolerance);
+    long long exact_calls = (long long)size * size * octaves;
+    long long multires_calls = 0;
+    float frequency = 1.0f;
+    printf("%-8s lattice steps (samples):", source.name());
+    for (int i = 0; i < octaves; i++) {
+        float frequency_x = scale * frequency / size;
+        multires_calls += multires_samples(size, size, frequency_x, frequency_x, spacing[i]);
+        printf(" %.2f", spacing[i] > frequency_x ? spacing[i] / frequency_x : 1.0f);
+        frequency *= 2.0f;
+    }
+    printf("\n");
+
+    // The sums are compared directly; the bound covers them, not the
+    // normalisation by each path's own octave value range.
+    float bound = multires_error_bound(source, size, size, scale, octaves, persistence, tolerance);
+    float error = max_difference(exact, multires);
+    bool within = error <= bound + SUM_ROUNDING;
+    printf("  exact     %9.2f ms  %10lld samples\n", exact_ms, exact_calls);
+    printf("  multires  %9.2f ms  %10lld samples  (%.2fx fewer, %.2fx faster)\n", multires_ms, multires_calls,
+           (double)exact_calls / multires_calls, exact_ms / multires_ms);
+    printf("  octave sum max error %.2e, bound %.2e, tolerance %.2e  %s  (octave value range %.3f)\n\n", error, bound, tolerance,
+           within ? "ok" : "EXCEEDED", exact_range);
+    return within;
+}
+
+// The octave loop generate_perlin_noise_at used before the fbm<> kernels.
+static float loop_perlin_noise_at(int x, int z, float scale, int octaves, float persistence) {
+    float total = 0.0f;
+    float max_val = 0.0f;
+    for (int i = 0; i < octaves; i++) {
+        float frequency = std::pow(2.0f, i);
+        float amplitude = std::pow(persistence, i);
+        total += perlin_noise(x / scale * frequency, z / scale * frequency) * amplitude;
+        max_val += amplitude;
+    }
+    return (total / max_val + 1.0f) / 2.0f;
+}
+
+static void bench_fbm(int size, float scale, float persistence) {
+    printf("fbm per sample, %d x %d grid:  loop ms | fbm<> ms (weights per grid) | generate_perlin_noise_at ms | speedups | max diff"
+           " | exact generate_fbm_rows ms\n", size, size);
+    PerlinNoiseSource perlin;
+    for (int octaves = 1; octaves <= FBM_MAX_SPECIALIZED_OCTAVES; octaves++) {
+        float sink = 0.0f;
+        std::vector<float> reference(size * size);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int z = 0; z < size; z++) {
+            for (int x = 0; x < size; x++) reference[z * size + x] = loop_perlin_noise_at(x, z, scale, octaves, persistence);
+        }
+        double loop_ms = elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+        Fbm_Weights weights = make_fbm_weights(octaves, persistence);
+        Fbm_Function kernel = select_fbm(PERLIN_NOISE, weights);
+        float error = 0.0f;
+        for (int z = 0; z < size; z++) {
+            for (int x = 0; x < size; x++) {
+                float v = (kernel(x / scale, z / scale, weights) + 1.0f) / 2.0f;
+                error = std::max(error, std::fabs(v - reference[z * size + x]));
+                sink += v;
+            }
+        }
+        double fbm_ms = elapsed_ms(start);
+
+        // The public per-sample entry point, which has to find its weights
+        // and kernel on every call.
+        start = std::chrono::steady_clock::now();
+        for (int z = 0; z < size; z++) {
+            for (int x = 0; x < size; x++) {
+                float v = generate_perlin_noise_at(x, z, scale, octaves, persistence);
+                error = std::max(error, std::fabs(v - reference[z * size + x]));
+                sink += v;
+            }
+        }
+        double at_ms = elapsed_ms(start);
+
+        // The batched row path grids use, at the same sample count (its
+        // frequencies are per grid rather than per sample, so only the time
+        // is comparable).
+        start = std::chrono::steady_clock::now();
+        std::vector<float> rows = generate_fbm_noise(perlin, size, size, size / scale, octaves, persistence);
+        double rows_ms = elapsed_ms(start);
+        sink += rows[0];
+
+        printf("  %2d octaves  %9.2f | %9.2f | %9.2f | %5.2fx | %5.2fx | %.2e | %9.2f  (%g)\n", octaves, loop_ms, fbm_ms, at_ms,
+               loop_ms / fbm_ms, loop_ms / at_ms, error, rows_ms, sink);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    int size = argc > 1 ? atoi(argv[1]) : 512;
+    int octaves = argc > 2 ? atoi(argv[2]) : 8;
+    float scale = argc > 3 ? (float)atof(argv[3]) : 10.0f;
+    float tolerance = argc > 4 ? (float)atof(argv[4]) : MULTIRES_TOLERANCE;
+    float persistence = 0.5f;
+
+    printf("size %d x %d, octaves %d, scale %.2f, multires tolerance %.2e\n\n", size, size, octaves, scale, tolerance);
+
+    bool ok = true;
+    Noise_Backend backends[] = {PERLIN_NOISE, SIMPLEX_NOISE, VALUE_NOISE};
+    for (unsigned int i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        std::unique_ptr<NoiseSource> source = make_noise_source(backends[i]);
+        if (!bench_multires(*source, size, scale, octaves, persistence, tolerance)) ok = false;
+    }
+
+    bench_fbm(size, scale * 4.0f, persistence);
+
+    for (unsigned int i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        std::unique_ptr<NoiseSource> source = make_noise_source(backends[i]);
+        if (!bench_backend(*source, size * size * 4)) ok = false;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
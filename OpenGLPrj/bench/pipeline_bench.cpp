@@ -0,0 +1,66 @@
+#include "terrain.hpp"
+#include "job_system.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct Terrain_Output {
+    std::vector<float> noise;
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+};
+
+// Best of `runs` constructions; Terrain construction is CPU-only, so no GL
+// context is needed.
+static double build_ms(int size, bool multires, Job_System* jobs, int runs, Terrain_Output& output) {
+    double best = 0.0;
+    for (int i = 0; i < runs; i++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        Terrain terrain(size, size, 0.1f, 20.0f, 10.0f, 4, 0.5f, multires, PERLIN_NOISE, jobs);
+        double ms = elapsed_ms(start);
+        if (i == 0 || ms < best) best = ms;
+        if (i == 0) {
+            output.noise = terrain.get_noise();
+            output.vertices = terrain.get_vertices();
+            output.indices = terrain.get_indices();
+        }
+    }
+    return best;
+}
+
+// Checks that every thread count builds exactly the serial terrain and prints
+// the times. They only show scaling when run on as many cores as threads.
+int main(int argc, char** argv) {
+    int size = argc > 1 ? atoi(argv[1]) : 1024;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 64;
+    int runs = argc > 3 ? atoi(argv[3]) : 3;
+    bool multires = argc > 4 && atoi(argv[4]) != 0;
+
+    printf("terrain %d x %d, multires %d, %u hardware threads, best of %d\n", size, size, multires ? 1 : 0,
+           std::thread::hardware_concurrency(), runs);
+
+    Terrain_Output reference;
+    double serial = build_ms(size, multires, nullptr, runs, reference);
+    printf("serial      %9.2f ms\n", serial);
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        std::unique_ptr<Job_System> jobs(new Job_System(threads));
+        Terrain_Output output;
+        double ms = build_ms(size, multires, jobs.get(), runs, output);
+        bool noise = output.noise == reference.noise;
+        bool vertices = output.vertices == reference.vertices;
+        bool indices = output.indices == reference.indices;
+        printf("%3d threads %9.2f ms  noise %s  vertices %s  indices %s\n", threads, ms, noise ? "identical" : "MISMATCH",
+               vertices ? "identical" : "MISMATCH", indices ? "identical" : "MISMATCH");
+        if (!noise || !vertices || !indices) return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -44,4 +44,5 @@ public:
     void process_keyboard(Camera_Movement direction, bool is_sprint, float delta_time);
     void process_mouse_movement(float x_offset, float y_offset, bool constrain_pitch = true);
     void process_mouse_scroll(float y_offset);
+    void set_orientation(float yaw, float pitch);
 };
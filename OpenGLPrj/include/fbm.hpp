@@ -0,0 +1,74 @@
+#pragma once
+
+#include "noise.hpp"
+#include "perlin.hpp"
+
+// Octave counts with a dedicated, fully unrolled fbm<> specialisation.
+const int FBM_MAX_SPECIALIZED_OCTAVES = 12;
+const int FBM_MAX_OCTAVES = 32;
+
+// Octave i samples at 2^i times the base frequency; known at compile time.
+constexpr float octave_frequency(int octave) {
+    return octave == 0 ? 1.0f : 2.0f * octave_frequency(octave - 1);
+}
+
+// Per-octave amplitudes and the reciprocal of their sum. Persistence is a
+// runtime parameter, so these are built once per grid/call rather than at
+// compile time, but never per sample.
+struct Fbm_Weights {
+    int octaves;
+    float amplitudes[FBM_MAX_OCTAVES];
+    float normalization;
+};
+
+// `octaves` is clamped to [1, FBM_MAX_OCTAVES]; the clamped count is stored
+// in the result, so callers can see whether their value was used as given.
+Fbm_Weights make_fbm_weights(int octaves, float persistence);
+
+struct Perlin_Backend {
+    static float sample(float x, float y) { return perlin_noise(x, y); }
+};
+
+struct Simplex_Backend {
+    static float sample(float x, float y) { return simplex_noise(x, y); }
+};
+
+struct Value_Backend {
+    static float sample(float x, float y) { return value_noise(x, y); }
+};
+
+template <int Octave, int Octaves, typename Backend>
+struct Fbm_Octaves {
+    static void accumulate(float x, float y, const float* amplitudes, float& total) {
+        const float frequency = octave_frequency(Octave);
+        total += Backend::sample(x * frequency, y * frequency) * amplitudes[Octave];
+        Fbm_Octaves<Octave + 1, Octaves, Backend>::accumulate(x, y, amplitudes, total);
+    }
+};
+
+template <int Octaves, typename Backend>
+struct Fbm_Octaves<Octaves, Octaves, Backend> {
+    static void accumulate(float, float, const float*, float&) {}
+};
+
+// Sum of Octaves octaves of Backend at (x, y), normalised to [-1, 1]. The
+// octave loop is unrolled at compile time and every frequency is a constant.
+template <int Octaves, typename Backend>
+float fbm(float x, float y, const Fbm_Weights& weights) {
+    static_assert(Octaves >= 1 && Octaves <= FBM_MAX_OCTAVES, "unsupported octave count");
+    float total = 0.0f;
+    Fbm_Octaves<0, Octaves, Backend>::accumulate(x, y, weights.amplitudes, total);
+    return total * weights.normalization;
+}
+
+typedef float (*Fbm_Function)(float x, float y, const Fbm_Weights& weights);
+
+// Picks the specialisation for weights.octaves (1-12) of the given backend,
+// or a generic loop for larger counts. Taking the weights rather than a count
+// keeps the kernel and its normalisation on the same, clamped octave count.
+//
+// These are for per-sample callers (generate_perlin_noise_at). Grids
+// (generate_fbm_rows, baked tiles) sample a whole row per octave through
+// NoiseSource::sample_batch, which is several times faster than any
+// per-sample kernel (see noise_bench), so they do not use them.
+Fbm_Function select_fbm(Noise_Backend backend, const Fbm_Weights& weights);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "terrain.hpp"
+#include "memory_stats.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class Shader;
+
+struct Gpu_Terrain_Params {
+    int width;
+    int height;
+    float scale;
+    float displacement;
+    float noise_scale;
+    int noise_octaves;
+    float noise_persistence;
+};
+
+// Terrain generation in compute shaders: exact (non-multires) Perlin fBm,
+// biome blending and, optionally, the mesh, written straight into the GL
+// objects that are drawn, so nothing crosses the bus. Needs OpenGL 4.3 and a
+// current context for its whole lifetime.
+class Gpu_Generator {
+    std::unique_ptr<Shader> noise_program;
+    std::unique_ptr<Shader> mesh_program;
+    unsigned int perm_buffer;
+    Memory_Tracker buffer_memory;
+    bool is_supported;
+
+public:
+    explicit Gpu_Generator(const std::string& shader_dir);
+    ~Gpu_Generator();
+
+    // Inline so CPU-only builds of Terrain need not link the generator.
+    bool supported() const { return is_supported; }
+
+    // Fills `texture` (GL_R32F, width x height, already allocated) with the
+    // blended heightfield. When `vbo` and `ebo` are non-zero they receive the
+    // vertices and indices in Terrain's mesh layout. Each pass is drained and
+    // appended to `timings`.
+    void generate(const Gpu_Terrain_Params& params, unsigned int texture, unsigned int vbo, unsigned int ebo, std::vector<Stage_Timing>& timings);
+};
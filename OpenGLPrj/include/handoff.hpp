@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free handoff of the newest value from one writer thread to one reader
+// thread. The writer fills write_slot() and publishes it; the reader always
+// gets the most recently published value and never waits, and neither side
+// ever touches the slot the other is using. Older unread values are dropped.
+template <typename T>
+class Triple_Buffer {
+    static const int FRESH = 4;
+
+    T slots[3];
+    // Slot between writer and reader; FRESH is set while it holds a value the
+    // reader has not taken yet.
+    std::atomic<int> middle;
+    int back;
+    int front;
+
+public:
+    Triple_Buffer() : middle(1), back(0), front(2) {}
+
+    T& write_slot() { return slots[back]; }
+
+    void publish() {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+    }
+
+    const T& read() {
+        if (middle.load(std::memory_order_acquire) & FRESH) {
+            front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+        }
+        return slots[front];
+    }
+};
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+template <typename T, unsigned int Capacity>
+class Spsc_Ring {
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+    T items[Capacity];
+    std::atomic<unsigned int> head;
+    std::atomic<unsigned int> tail;
+
+public:
+    Spsc_Ring() : head(0), tail(0) {}
+
+    // Producer; false when full.
+    bool push(const T& item) {
+        unsigned int t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+        items[t % Capacity] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer; false when empty.
+    bool pop(T& item) {
+        unsigned int h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        item = items[h % Capacity];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
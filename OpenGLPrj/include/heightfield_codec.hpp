@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Half of an 8-bit step of the normalised height range: the coarsest error
+// an 8-bit heightmap would already have. It is also what reaches the 8x size
+// target; on the 6-octave Perlin tiles codec_bench uses, 1e-3 only gives 7.7x
+// and 0.5 / 255 gives 9.5x.
+const float HEIGHTFIELD_DEFAULT_TOLERANCE = 0.5f / 255.0f;
+// Largest quantised magnitude; keeps planar predictions and their residuals
+// within int.
+const int HEIGHTFIELD_MAX_QUANTIZED = 1 << 28;
+
+// Lossy heightfield codec. Heights are quantised to a uniform grid of
+// 2 * tolerance (so every decoded sample is within `tolerance` of the input,
+// plus the float rounding of the reconstructed height),
+// predicted from their left/upper/upper-left neighbours with a planar
+// predictor, and the residuals are Huffman coded with one code shared by the
+// whole field. The field is split into independently coded square blocks,
+// which gives random access and parallel decoding; each block is coded as a
+// few bitstreams over row bands that decode in lockstep, and the decoder's
+// table yields several short codes per lookup.
+//
+// Quantisation is anchored at zero rather than at the field minimum, so equal
+// heights in different fields (e.g. the shared border of two tiles) decode to
+// bit-identical values. Returns an empty vector when the tolerance is not
+// positive, a height is not finite, or the largest |height| / (2 * tolerance)
+// exceeds HEIGHTFIELD_MAX_QUANTIZED.
+std::vector<unsigned char> encode_heightfield(const float* heights, int width, int height, float tolerance, int block_size = 64);
+
+// Up to three symbols decoded by one table lookup; info holds the bits they
+// use in its low four bits and their count above that.
+struct Decode_Entry {
+    unsigned char symbols[3];
+    unsigned char info;
+};
+
+class Heightfield_Decoder {
+    const unsigned char* data;
+    size_t size;
+    bool is_valid;
+
+    int width;
+    int height;
+    int block_size;
+    int blocks_x;
+    int blocks_z;
+    float step;
+
+    std::vector<unsigned int> block_offsets;
+    std::vector<Decode_Entry> single;
+    std::vector<Decode_Entry> runs;
+
+public:
+    Heightfield_Decoder(const unsigned char* data, size_t size);
+
+    bool valid() const;
+    int get_width() const;
+    int get_height() const;
+    int get_block_size() const;
+    int get_blocks_x() const;
+    int get_blocks_z() const;
+
+    // Decodes one block into `out`, a row-major array covering the whole field.
+    bool decode_block(int block_x, int block_z, float* out) const;
+    bool decode(std::vector<float>& out, int threads = 1) const;
+};
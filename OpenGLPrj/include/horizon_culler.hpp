@@ -0,0 +1,55 @@
+#pragma once
+
+#include "memory_stats.hpp"
+
+#include <vector>
+
+// World-space bounds of one terrain patch.
+struct Patch_Bounds {
+    float min_x, min_z;
+    float max_x, max_z;
+    float min_y, max_y;
+};
+
+const int HORIZON_BINS = 1024;
+
+// Occlusion culling against the terrain itself. Patches are swept
+// front-to-back from the eye while a 1D horizon records, per azimuth bin, the
+// steepest slope below which every ray is already known to hit the ground. A
+// patch whose highest point lies under the horizon across all of its bins is
+// hidden. Only occluder cells entirely nearer than the patch being tested
+// have raised the horizon, so the test is conservative. CPU-only.
+class Horizon_Culler {
+    struct Occluder {
+        float far_distance;
+        int first_bin;
+        int bin_count;
+        float slope;
+        // Reversed so the heap yields the smallest far_distance first.
+        bool operator<(const Occluder& other) const { return far_distance > other.far_distance; }
+    };
+
+    int bins;
+    std::vector<Patch_Bounds> patches;
+    std::vector<Patch_Bounds> occluders;
+    std::vector<float> horizon;
+    std::vector<std::pair<float, int> > order;
+    std::vector<Occluder> pending;
+    Memory_Tracker memory;
+    
+    void track_memory();
+
+    void azimuth_bins(const Patch_Bounds& patch, float eye_x, float eye_z, int& first_bin, int& last_bin) const;
+    bool horizon_above(int first_bin, int count, float slope) const;
+    void flush_occluders(float distance);
+
+public:
+    explicit Horizon_Culler(int bins = HORIZON_BINS);
+
+    // `occluders` are the cells that raise the horizon; they may be finer than
+    // the patches, which only ever get tested.
+    void set_patches(const std::vector<Patch_Bounds>& patches, const std::vector<Patch_Bounds>& occluders);
+    // visible[i] is set to 0 for every hidden patch and 1 otherwise; returns
+    // the number of hidden patches.
+    int cull(float eye_x, float eye_y, float eye_z, std::vector<unsigned char>& visible);
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Job;
+typedef std::shared_ptr<Job> Job_Handle;
+
+// Small work-stealing scheduler. Every thread owns a deque: it pushes and pops
+// its own jobs at the back (most recently spawned first, which keeps data hot)
+// while idle threads steal from the front of other deques. A job becomes
+// runnable once all of its dependencies have finished. Threads that wait on a
+// job run other jobs in the meantime, so waiting from inside a job is safe,
+// and sleep once there is nothing left to help with.
+class Job_System {
+    struct Worker_Queue {
+        std::mutex mutex;
+        std::deque<Job_Handle> jobs;
+    };
+
+    std::vector<std::unique_ptr<Worker_Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    // Signalled when a job finishes or new work arrives while a thread waits.
+    std::condition_variable finished;
+    std::atomic<int> queued;
+    std::atomic<int> waiting;
+    bool stopping;
+
+    int current_queue() const;
+    void push(const Job_Handle& job);
+    Job_Handle find_job(int queue);
+    void run(const Job_Handle& job);
+    void worker_loop(int queue);
+
+public:
+    // `thread_count` counts the calling thread, which helps while it waits;
+    // 0 uses every hardware thread.
+    explicit Job_System(int thread_count = 0);
+    ~Job_System();
+
+    int get_thread_count() const;
+
+    Job_Handle submit(std::function<void()> work);
+    Job_Handle submit(std::function<void()> work, const std::vector<Job_Handle>& dependencies);
+    void wait(const Job_Handle& job);
+    // Splits [begin, end) into chunks of at most `grain` items and runs
+    // body(chunk_begin, chunk_end) for each in parallel; returns when all are
+    // done.
+    void parallel_for(int begin, int end, int grain, const std::function<void(int, int)>& body);
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+
+// Appends to a plain text log; needs no GL or window, so CPU-only tools and
+// benchmarks can link it on its own.
+bool restart_gl_log(const std::string& log_file_path);
+bool gl_log(const std::string& log_file_path, const char* message, ...);
+bool gl_log_err(const std::string& log_file_path, const char* message, ...);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+enum Memory_Tag {
+    MEMORY_NOISE,
+    MEMORY_MESH,
+    MEMORY_GPU_BUFFERS,
+    MEMORY_TEXTURES,
+    // Derived data kept between frames, e.g. culling bounds.
+    MEMORY_CACHES,
+    MEMORY_TAG_COUNT
+};
+
+struct Memory_Tag_Stats {
+    long long current;
+    long long peak;
+    // Trackers currently holding memory, and size changes ever reported to
+    // them (a tracker set to a new non-zero size counts once). These count
+    // trackers, not heap or GL allocations.
+    long long live_trackers;
+    long long resizes;
+};
+
+const char* memory_tag_name(Memory_Tag tag);
+bool memory_tag_on_gpu(Memory_Tag tag);
+Memory_Tag_Stats memory_stats(Memory_Tag tag);
+
+// Bytes of a width x height texture, including its mip chain when `mipmaps`.
+// An estimate: drivers may pad or compress.
+size_t estimate_texture_bytes(int width, int height, int bytes_per_texel, bool mipmaps);
+
+// Accounts one allocation (a container, a GL buffer or texture) under a tag.
+// set() is called with the new size whenever the allocation changes; the
+// destructor releases whatever is still held. Thread-safe.
+class Memory_Tracker {
+    Memory_Tag tag;
+    size_t bytes;
+
+    Memory_Tracker(const Memory_Tracker&);
+    Memory_Tracker& operator=(const Memory_Tracker&);
+
+public:
+    explicit Memory_Tracker(Memory_Tag tag);
+    ~Memory_Tracker();
+
+    void set(size_t bytes);
+    size_t get() const;
+};
+
+// Prometheus text format when the path ends in .prom, JSON otherwise. The file
+// is written to a temporary name and moved over the old one, so readers never
+// see half of it.
+bool write_memory_stats(const std::string& path);
+void print_memory_stats(FILE* file);
+
+// Rewrites a stats file at most once per interval; call poll() every frame.
+class Memory_Stats_Writer {
+    std::string path;
+    double interval_ms;
+    double next_ms;
+
+public:
+    Memory_Stats_Writer(const std::string& path, double interval_s);
+
+    void poll();
+    bool write();
+};
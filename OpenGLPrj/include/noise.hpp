@@ -0,0 +1,96 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+enum Noise_Backend {
+    PERLIN_NOISE,
+    SIMPLEX_NOISE,
+    VALUE_NOISE
+};
+
+float simplex_noise(float x, float y);
+float simplex_noise(float x, float y, float z);
+float value_noise(float x, float y);
+float value_noise(float x, float y, float z);
+
+// Gradient/value noise primitive shared by terrain generation. Every backend
+// returns values in roughly [-1, 1]. The batch entry points evaluate `count`
+// independent samples and are vectorised where the backend supports it.
+class NoiseSource {
+public:
+    virtual ~NoiseSource() {}
+
+    virtual const char* name() const = 0;
+    virtual float sample(float x, float y) const = 0;
+    virtual float sample(float x, float y, float z) const = 0;
+    // Upper bound on |d3/dx3| and |d3/dy3| of the 2D sample(), per cubed noise
+    // unit; sizes the multires lattices against their error budget.
+    virtual float third_derivative_bound() const = 0;
+    virtual void sample_batch(const float* x, const float* y, float* out, int count) const;
+    virtual void sample_batch(const float* x, const float* y, const float* z, float* out, int count) const;
+};
+
+class PerlinNoiseSource : public NoiseSource {
+public:
+    const char* name() const override;
+    float sample(float x, float y) const override;
+    float sample(float x, float y, float z) const override;
+    float third_derivative_bound() const override;
+    void sample_batch(const float* x, const float* y, float* out, int count) const override;
+    void sample_batch(const float* x, const float* y, const float* z, float* out, int count) const override;
+};
+
+class SimplexNoiseSource : public NoiseSource {
+public:
+    const char* name() const override;
+    float sample(float x, float y) const override;
+    float sample(float x, float y, float z) const override;
+    float third_derivative_bound() const override;
+    void sample_batch(const float* x, const float* y, float* out, int count) const override;
+    void sample_batch(const float* x, const float* y, const float* z, float* out, int count) const override;
+};
+
+class ValueNoiseSource : public NoiseSource {
+public:
+    const char* name() const override;
+    float sample(float x, float y) const override;
+    float sample(float x, float y, float z) const override;
+    float third_derivative_bound() const override;
+    void sample_batch(const float* x, const float* y, float* out, int count) const override;
+    void sample_batch(const float* x, const float* y, const float* z, float* out, int count) const override;
+};
+
+std::unique_ptr<NoiseSource> make_noise_source(Noise_Backend backend);
+
+// Default multires error budget for an octave sum, in noise units: half an
+// 8-bit step of a [0, 1] height. Heightfields are then normalised by the range
+// of the octave values, about 2 for every backend (bench/noise_bench).
+const float MULTIRES_TOLERANCE = 0.5f / 255.0f;
+
+// Lattice spacing, in noise units, at which a Catmull-Rom reconstruction of
+// `source` stays within `tolerance` of the exact samples; 0 when tolerance is 0.
+float multires_spacing(const NoiseSource& source, float tolerance);
+// The same for every octave of an fBm sum, with `tolerance` split between the
+// octaves so the total number of samples is smallest.
+std::vector<float> multires_octave_spacings(const NoiseSource& source, int width, int height, float scale, int octaves, float persistence, float tolerance);
+// Samples evaluated for one octave at `spacing`: the lattice when it has fewer
+// samples than the width x height grid, otherwise the grid itself.
+long long multires_samples(int width, int height, float frequency_x, float frequency_y, float spacing);
+// Bound on |multires - exact| of the octave sum generate_fbm_rows accumulates,
+// from the Catmull-Rom error term and the backend's third-derivative bound; it
+// never exceeds `tolerance`. generate_fbm_noise divides the sum by the range
+// of the octave values, and its error bound by the same.
+float multires_error_bound(const NoiseSource& source, int width, int height, float scale, int octaves, float persistence, float tolerance);
+
+// Samples source(x * frequency_x, y * frequency_y) over a width x height grid.
+// With a positive tolerance the grid is reconstructed from a coarser lattice
+// (see multires_spacing), at a fractional step where needed; 0 is exact.
+std::vector<float> generate_noise_grid(const NoiseSource& source, int width, int height, float frequency_x, float frequency_y, float tolerance = 0.0f);
+// Row-range forms of the above for banded generation: rows [row_begin, row_end)
+// of the full grid are written to `out`, bit-identical to the whole-grid call.
+// generate_fbm_rows adds the unnormalised octave sum and widens min/max by the
+// octave values; generate_fbm_noise normalises by them.
+void generate_noise_rows(const NoiseSource& source, int width, int height, int row_begin, int row_end, float frequency_x, float frequency_y, float tolerance, float* out);
+void generate_fbm_rows(const NoiseSource& source, int width, int height, int row_begin, int row_end, float scale, int octaves, float persistence, float tolerance, float* out, float& min_val, float& max_val);
+std::vector<float> generate_fbm_noise(const NoiseSource& source, int width, int height, float scale, int octaves, float persistence, float tolerance = 0.0f);
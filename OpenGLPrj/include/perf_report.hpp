@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Collects per-frame stage samples, one-off setup timings and scalar values
+// for a benchmark run and writes them out as a single JSON document.
+class Perf_Report {
+    struct Stage {
+        std::string name;
+        std::vector<double> samples;
+    };
+    struct Value {
+        std::string name;
+        double value;
+    };
+
+    std::vector<Stage> stages;
+    std::vector<Value> setup;
+    std::vector<Value> values;
+
+public:
+    void add_sample(const std::string& stage, double ms);
+    void add_setup(const std::string& stage, double ms);
+    void set_value(const std::string& name, double value);
+
+    double percentile(const std::string& stage, double p) const;
+    bool write_json(const std::string& path) const;
+};
@@ -1,13 +1,31 @@
 #pragma once
 
+#include "noise.hpp"
+
 #include <vector>
 
+extern const int perlin_perm[256];
+
+// floor() for lattice lookups: a truncating cast corrected for negatives,
+// without the libm call and float round trip. Valid while |x| < 2^31.
+inline int fast_floor(float x) {
+    int i = (int)x;
+    return i - (x < (float)i);
+}
+
 float fade(float t);
 float lerp(float t, float a, float b);
 float grad(int hash, float x, float y);
+float grad(int hash, float x, float y, float z);
 float perlin_noise(float x, float y);
+float perlin_noise(float x, float y, float z);
+// Octaves outside [1, FBM_MAX_OCTAVES] are clamped, as in make_fbm_weights;
+// 0 octaves used to give NaN and counts above 32 were summed in full.
 float generate_perlin_noise_at(int x, int z, float scale, int octaves, float persistence);
 std::vector<float> generate_perlin_noise(int width, int height, float scale);
 std::vector<float> generate_perlin_noise(int width, int height, float scale, int octaves, float persistence);
+// generate_fbm_noise over Perlin noise within `tolerance` of the exact sum;
+// see multires_error_bound for what that bounds.
+std::vector<float> generate_perlin_noise_multires(int width, int height, float scale, int octaves, float persistence, float tolerance = MULTIRES_TOLERANCE);
 void apply_gaussian_blur(std::vector<float>& noise, int width, int height);
 void apply_gaussian_blur(std::vector<float>& noise, int width, int height, int kernel_size, float sigma);
\ No newline at end of file
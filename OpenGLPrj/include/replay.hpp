@@ -0,0 +1,33 @@
+#pragma once
+
+#include "camera.hpp"
+#include "utils.hpp"
+
+#include <string>
+#include <vector>
+
+struct Camera_State {
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+    float zoom;
+};
+
+struct Replay_Tick {
+    Input_Frame input;
+    Camera_State camera;
+};
+
+// A recorded session: the camera it started from and, for every fixed
+// simulation step, the input applied and the camera state that resulted.
+struct Replay {
+    float timestep;
+    Camera_State start;
+    std::vector<Replay_Tick> ticks;
+};
+
+Camera_State capture_camera_state(const Camera& camera);
+void restore_camera_state(Camera& camera, const Camera_State& state);
+float camera_state_drift(const Camera_State& a, const Camera_State& b);
+bool save_replay(const std::string& path, const Replay& replay);
+bool load_replay(const std::string& path, Replay& replay);
@@ -9,11 +9,17 @@ class Shader {
     unsigned int id;
 
     void check_compile_errors(unsigned int shader, std::string type);
+    unsigned int compile_stage(unsigned int type, const std::string& code, const char* label);
 public:
     Shader(const char* vertex_path, const char* fragment_path);
+    // Program with tessellation control and evaluation stages (GL 4.0).
+    Shader(const char* vertex_path, const char* tess_control_path, const char* tess_evaluation_path, const char* fragment_path);
+    // Compute program (OpenGL 4.3).
+    explicit Shader(const char* compute_path);
     ~Shader();
 
     void use();
+    bool valid() const;
     void set_bool(const std::string& name, bool value) const;
     void set_int(const std::string& name, int value) const;
     void set_float(const std::string& name, float value) const;
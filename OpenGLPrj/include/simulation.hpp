@@ -0,0 +1,78 @@
+#pragma once
+
+#include "camera.hpp"
+#include "handoff.hpp"
+#include "replay.hpp"
+#include "terrain.hpp"
+#include "utils.hpp"
+
+#include <atomic>
+#include <thread>
+
+// Camera state of the two most recent simulation ticks, so the renderer can
+// interpolate between them, plus the newest input that reached them.
+struct Camera_Snapshot {
+    Camera_State previous;
+    Camera_State current;
+    // now_ms() when `current` was produced.
+    double tick_ms;
+    unsigned int tick;
+    // Sequence number and poll time of the newest input sample with any
+    // activity that `current` includes; sequence 0 means none yet.
+    unsigned int input_sequence;
+    double input_ms;
+    // Patches visible from `current` when the simulation culls a terrain;
+    // not culled otherwise.
+    Terrain_Draw_Ranges draw_ranges;
+};
+
+// Runs the camera at a fixed timestep on its own thread. The main thread
+// feeds it polled input through a lock-free queue and reads back snapshots
+// through a triple buffer, so neither side ever blocks on the other and a
+// slow frame never stretches a simulation step.
+class Simulation {
+    struct Timed_Input {
+        Input_Frame input;
+        unsigned int sequence;
+        double time_ms;
+    };
+
+    Camera camera;
+    float timestep;
+    Replay* recording;
+    Terrain* cull_terrain;
+
+    Spsc_Ring<Timed_Input, 256> inputs;
+    Triple_Buffer<Camera_Snapshot> snapshots;
+    std::atomic<bool> running;
+    std::thread thread;
+
+    // Main thread: input the full queue could not take yet.
+    Timed_Input carry;
+    unsigned int next_sequence;
+
+    void loop();
+
+public:
+    // Appends every tick to `recording` when given; it may only be read
+    // after stop(). With `cull_terrain`, every tick horizon-culls it from the
+    // new camera position and publishes the draw ranges with the snapshot;
+    // nothing else may cull that terrain while the simulation runs.
+    Simulation(const Camera& camera, float timestep, Replay* recording = nullptr, Terrain* cull_terrain = nullptr);
+    ~Simulation();
+
+    void start();
+    void stop();
+
+    // Main thread.
+    void push_input(const Input_Frame& input);
+
+    // Render thread; never blocks. The reference stays valid until the next
+    // call.
+    const Camera_Snapshot& latest_snapshot();
+};
+
+Camera_State interpolate_camera_state(const Camera_State& a, const Camera_State& b, float t);
+
+// Fraction of a timestep elapsed since `snapshot` was produced, in [0, 1].
+float snapshot_alpha(const Camera_Snapshot& snapshot, double time_ms, float timestep);
@@ -1,7 +1,46 @@
 #pragma once
 
+#include "noise.hpp"
+#include "job_system.hpp"
+#include "horizon_culler.hpp"
+#include "memory_stats.hpp"
+
+#include <memory>
+#include <string>
 #include <vector>
 
+enum Terrain_Render_Mode {
+    TERRAIN_MESH,
+    // Coarse patches tessellated on the GPU and displaced from the height
+    // texture; no CPU vertex/index mesh is built.
+    TERRAIN_TESSELLATED
+};
+
+// Quads along one edge of a patch, the unit of tessellation and culling. Mesh
+// indices are stored patch by patch so every patch is one contiguous range.
+const int TERRAIN_PATCH_QUADS = 16;
+// Finer cells used as occluders: their tighter minimum heights raise the
+// culling horizon further than whole patches would.
+const int TERRAIN_OCCLUDER_QUADS = 8;
+
+class Shader;
+class Gpu_Generator;
+
+// Draws covering the visible patches, as cull_hidden_patches produces them;
+// when `culled` is false render() draws every patch.
+struct Terrain_Draw_Ranges {
+    bool culled;
+    std::vector<int> first, count;
+    std::vector<const void*> offsets;
+
+    Terrain_Draw_Ranges() : culled(false) {}
+};
+
+struct Stage_Timing {
+    std::string name;
+    double ms;
+};
+
 class Terrain {
     int width;
     int height;
@@ -11,23 +50,77 @@ class Terrain {
     float noise_scale;
     int noise_octaves;
     float noise_persistence;
+    bool noise_multires;
+    Terrain_Render_Mode render_mode;
+    std::unique_ptr<NoiseSource> noise_source;
     std::vector<float> noise;
     
     std::vector<float> vertices;
     std::vector<unsigned int> indices;
+    int index_count;
+    int patch_vertex_count;
+    int patches_x, patches_z;
+    
+    Horizon_Culler culler;
+    std::vector<unsigned char> patch_visible;
+    Gpu_Generator* gpu_generator;
     
     unsigned int vao, vbo, ebo, texture_id;
+    // Set by upload_to_gpu. Called through a pointer so that terrain.cpp, the
+    // CPU half, links without GL (pipeline_bench builds terrains without it).
+    void (*release_gl)(Terrain& terrain);
+    Memory_Tracker noise_memory, mesh_memory, buffer_memory, texture_memory;
+    
+    std::vector<Stage_Timing> stage_timings;
     
-    void apply_biome_blending();
-    void generate_noise();
-    void generate_vertices();
-    void generate_indices();
-    void generate_texture();
+    // Every stage works on a band of rows [row_begin, row_end) so bands can
+    // be built in parallel; the serial path uses one band.
+    void generate_noise(int row_begin, int row_end);
+    void generate_biome(int row_begin, int row_end, float* biome, float* field);
+    void apply_biome_blending(int row_begin, int row_end, const float* biome, const float* field);
+    void generate_vertices(int row_begin, int row_end);
+    void generate_indices(int row_begin, int row_end);
+    int patch_first_quad(int patch_x, int patch_z) const;
+    int patch_quad_count(int patch_x, int patch_z) const;
+    void build_patch_bounds(const float* heights);
+    void generate_texture(const float* data);
+    void create_mesh_buffers(const float* vertex_data, const unsigned int* index_data);
+    void upload_patches();
+    void generate_on_gpu();
+    static void delete_gl_objects(Terrain& terrain);
+    void build_serial();
+    void build_parallel(Job_System& jobs);
+    void record_stage(const char* name, double start_ms);
     
     public:
-    Terrain(int width, int height, float scale, float displacement, float noise_scale, int noise_octaves, float noise_persistence);
+    // Construction is CPU-only (and runs on `jobs` when given); GL objects are
+    // created by upload_to_gpu. With a supported `gpu_generator` nothing is
+    // generated here: upload_to_gpu runs the whole pipeline in compute shaders
+    // (exact Perlin only, so multires and other backends fall back to the CPU).
+    Terrain(int width, int height, float scale, float displacement, float noise_scale, int noise_octaves, float noise_persistence, bool noise_multires = false, Noise_Backend noise_backend = PERLIN_NOISE, Job_System* jobs = nullptr, Terrain_Render_Mode render_mode = TERRAIN_MESH, Gpu_Generator* gpu_generator = nullptr);
     ~Terrain();
     
     void upload_to_gpu();
-    void render() const;
+    // Draws `ranges` when given and culled, every patch otherwise.
+    void render(const Terrain_Draw_Ranges* ranges = nullptr) const;
+    // Uniforms the tessellation shaders need to place and shade vertices.
+    void set_tessellation_uniforms(const Shader& shader) const;
+    Terrain_Render_Mode get_render_mode() const;
+    // Horizon-culls the patches from `eye` into `ranges` for render(); returns
+    // the fraction of mesh triangles rejected. Touches no GL state, so it may
+    // run on another thread than render(), but only one thread may cull at a
+    // time.
+    float cull_hidden_patches(float eye_x, float eye_y, float eye_z, Terrain_Draw_Ranges& ranges);
+    // Bytes of vertex and index data uploaded for drawing.
+    size_t get_geometry_bytes() const;
+    
+    // Copies back what was uploaded: the height texture and, for the mesh
+    // mode, the vertex and index buffers.
+    void read_back(std::vector<float>& heights, std::vector<float>& vertex_data, std::vector<unsigned int>& index_data) const;
+    bool generated_on_gpu() const;
+    
+    const std::vector<float>& get_noise() const;
+    const std::vector<float>& get_vertices() const;
+    const std::vector<unsigned int>& get_indices() const;
+    const std::vector<Stage_Timing>& get_stage_timings() const;
 };
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "noise.hpp"
+
+#include <string>
+#include <vector>
+
+struct Tile_Params {
+    int tile_size;
+    float scale;
+    int octaves;
+    float persistence;
+    Noise_Backend backend;
+};
+
+// A baked tile holds (tile_size + 1)^2 heights sampled at integer world
+// coordinates, so neighbouring tiles share their border row and column.
+struct Tile {
+    int tile_x;
+    int tile_z;
+    int samples;
+    std::vector<float> heights;
+};
+
+// Heights depend only on the world coordinate of each sample (as in
+// generate_perlin_noise_at), never on tile extents, which keeps seams exact.
+void generate_tile(const NoiseSource& source, const Tile_Params& params, int tile_x, int tile_z, Tile& tile);
+// A positive tolerance stores the heights with the compressed heightfield
+// codec instead of as raw floats; read_tile handles both and rejects tiles
+// that do not hold (tile_size + 1)^2 samples.
+bool write_tile(const std::string& path, const Tile& tile, float tolerance = 0.0f);
+bool read_tile(const std::string& path, int tile_size, Tile& tile);
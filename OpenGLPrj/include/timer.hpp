@@ -0,0 +1,7 @@
+#pragma once
+
+#include <chrono>
+
+inline double now_ms() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
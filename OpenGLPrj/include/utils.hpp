@@ -1,17 +1,41 @@
 #pragma once
 
 #include "camera.hpp"
+#include "log.hpp"
 
 #include <GLFW/glfw3.h>
 #include <string>
 
-bool init_opengl(GLFWwindow*& window, int window_width, int window_height, const char* title);
-void configure_opengl(GLFWwindow* window, Camera& camera);
-bool restart_gl_log(const std::string& log_file_path);
-bool gl_log(const std::string& log_file_path, const char* message, ...);
-bool gl_log_err(const std::string& log_file_path, const char* message, ...);
+const float FIXED_TIMESTEP = 1.0f / 60.0f;
+
+enum Input_Key {
+    INPUT_FORWARD  = 1 << 0,
+    INPUT_BACKWARD = 1 << 1,
+    INPUT_LEFT     = 1 << 2,
+    INPUT_RIGHT    = 1 << 3,
+    INPUT_UP       = 1 << 4,
+    INPUT_DOWN     = 1 << 5,
+    INPUT_SPRINT   = 1 << 6
+};
+
+// Input gathered between two polls: held keys plus mouse and scroll deltas
+// accumulated by the GLFW callbacks.
+struct Input_Frame {
+    unsigned int keys;
+    float mouse_dx;
+    float mouse_dy;
+    float scroll;
+};
+
+bool init_opengl(GLFWwindow*& window, int window_width, int window_height, const char* title, bool visible = true);
+bool init_opengl_headless(GLFWwindow*& window, int width, int height);
+void shutdown_opengl(GLFWwindow* window);
+bool display_available();
+void configure_opengl(GLFWwindow* window);
 void glfw_error_callback(int error, const char* description);
 void glfw_framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void glfw_mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void glfw_scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+Input_Frame poll_input(GLFWwindow* window);
+void apply_input(Camera& camera, const Input_Frame& input, float delta_time);
 void process_input(GLFWwindow* window, Camera& camera, float delta_time);
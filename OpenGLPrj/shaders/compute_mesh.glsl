@@ -0,0 +1,51 @@
+#version 430 core
+
+// Builds the vertex and index buffers from the height image, one invocation
+// per sample. Same layout, colours and patch-major index order as
+// Terrain::generate_vertices/indices.
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(r32f, binding = 0) uniform readonly image2D heightImage;
+layout(std430, binding = 3) writeonly buffer Vertices { float vertices[]; };
+layout(std430, binding = 4) writeonly buffer Indices { uint indices[]; };
+
+uniform int gridWidth;
+uniform int gridHeight;
+uniform float gridSpacing;
+uniform float displacement;
+uniform int patchQuads;
+
+void main() {
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (p.x >= gridWidth || p.y >= gridHeight) return;
+
+    float noiseHeight = imageLoad(heightImage, p).r * gridSpacing * displacement * 2.0;
+    float maxHeight = gridSpacing * displacement;
+    float t = clamp(noiseHeight / maxHeight, 0.0, 1.0);
+
+    int base = (p.y * gridWidth + p.x) * 8;
+    vertices[base + 0] = float(p.x) * gridSpacing;
+    vertices[base + 1] = noiseHeight;
+    vertices[base + 2] = float(p.y) * gridSpacing;
+    vertices[base + 3] = (1.0 - t) * 0.2 + t * 0.5;
+    vertices[base + 4] = (1.0 - t) * 0.9 + t * 0.5;
+    vertices[base + 5] = (1.0 - t) * 0.2 + t * 0.5;
+    vertices[base + 6] = float(p.x) / float(gridWidth);
+    vertices[base + 7] = float(p.y) / float(gridHeight);
+
+    if (p.x >= gridWidth - 1 || p.y >= gridHeight - 1) return;
+    uint topLeft = uint(p.y * gridWidth + p.x);
+    uint bottomLeft = topLeft + uint(gridWidth);
+    ivec2 tile = p / patchQuads;
+    ivec2 local = p - tile * patchQuads;
+    int patchHeight = min(patchQuads, gridHeight - 1 - tile.y * patchQuads);
+    int patchWidth = min(patchQuads, gridWidth - 1 - tile.x * patchQuads);
+    int firstQuad = tile.y * patchQuads * (gridWidth - 1) + tile.x * patchQuads * patchHeight;
+    int quad = (firstQuad + local.y * patchWidth + local.x) * 6;
+    indices[quad + 0] = topLeft;
+    indices[quad + 1] = bottomLeft;
+    indices[quad + 2] = topLeft + 1u;
+    indices[quad + 3] = topLeft + 1u;
+    indices[quad + 4] = bottomLeft;
+    indices[quad + 5] = bottomLeft + 1u;
+}
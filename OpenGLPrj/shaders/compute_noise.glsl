@@ -0,0 +1,79 @@
+#version 430 core
+
+// One invocation per sample: fBm sum, normalised by the octave amplitude sum,
+// blended with the biome/field noise and stored as the height. Mirrors
+// generate_fbm_rows + apply_biome_blending (Perlin backend).
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(std430, binding = 0) readonly buffer Permutation { int perm[256]; };
+layout(r32f, binding = 0) uniform writeonly image2D heightImage;
+
+uniform int gridWidth;
+uniform int gridHeight;
+uniform float noiseScale;
+uniform int octaves;
+uniform float persistence;
+uniform float fieldFrequency;
+
+float fade(float t) {
+    return t * t * t * (t * (t * 6.0 - 15.0) + 10.0);
+}
+
+float lerp(float t, float a, float b) {
+    return a + t * (b - a);
+}
+
+float grad(int hash, float x, float y) {
+    int h = hash & 15;
+    float u = h < 8 ? x : y;
+    float v = h < 4 ? y : (h == 12 || h == 14) ? x : y;
+    return ((h & 1) != 0 ? -1.0 : 1.0) * (u + v);
+}
+
+float perlin(float x, float y) {
+    float fx = floor(x);
+    float fy = floor(y);
+    int X = int(fx) & 255;
+    int Y = int(fy) & 255;
+    x -= fx;
+    y -= fy;
+
+    float u = fade(x);
+    float v = fade(y);
+
+    int a = perm[X] + Y;
+    int b = perm[(X + 1) & 255] + Y;
+    int aa = perm[a & 255];
+    int ab = perm[(a + 1) & 255];
+    int ba = perm[b & 255];
+    int bb = perm[(b + 1) & 255];
+
+    float x1 = lerp(u, grad(aa, x, y), grad(ba, x - 1.0, y));
+    float x2 = lerp(u, grad(ab, x, y - 1.0), grad(bb, x - 1.0, y - 1.0));
+    return lerp(v, x1, x2);
+}
+
+void main() {
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (p.x >= gridWidth || p.y >= gridHeight) return;
+
+    float total = 0.0;
+    float maxVal = 0.0;
+    float frequency = 1.0;
+    float amplitude = 1.0;
+    for (int i = 0; i < octaves; i++) {
+        float fx = noiseScale * frequency / float(gridWidth);
+        float fy = noiseScale * frequency / float(gridHeight);
+        total += perlin(float(p.x) * fx, float(p.y) * fy) * amplitude;
+        maxVal += amplitude;
+        frequency *= 2.0;
+        amplitude *= persistence;
+    }
+
+    float hill = (total / maxVal + 1.0) / 2.0;
+    float biome = perlin(float(p.x) * 0.01, float(p.y) * 0.01);
+    float field = perlin(float(p.x) * fieldFrequency, float(p.y) * fieldFrequency);
+    float b = (biome + 1.0) / 2.0;
+    float f = pow((field + 1.0) / 2.0, 10.0);
+    imageStore(heightImage, p, vec4((1.0 - b) * f + b * hill));
+}
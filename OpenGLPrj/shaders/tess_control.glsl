@@ -0,0 +1,62 @@
+#version 400 core
+
+layout(vertices = 4) out;
+
+in vec2 vGrid[];
+out vec2 tcGrid[];
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform sampler2D perlinTexture;
+uniform vec2 gridSize;
+uniform float gridSpacing;
+uniform float heightScale;
+
+uniform vec2 viewportSize;
+uniform float pixelsPerSegment;
+
+vec4 corner_clip(int i) {
+    vec2 uv = (vGrid[i] + 0.5) / gridSize;
+    float h = textureLod(perlinTexture, uv, 0.0).r * heightScale;
+    return projection * view * model * vec4(vGrid[i].x * gridSpacing, h, vGrid[i].y * gridSpacing, 1.0);
+}
+
+// Segments for an edge from its projected length. Each level depends only on
+// the edge's two endpoints, so neighbouring patches agree and no cracks open.
+float edge_level(vec4 a, vec4 b) {
+    if (a.w <= 0.0 || b.w <= 0.0) return 64.0;
+    vec2 sa = a.xy / a.w * 0.5 * viewportSize;
+    vec2 sb = b.xy / b.w * 0.5 * viewportSize;
+    return clamp(distance(sa, sb) / pixelsPerSegment, 1.0, 64.0);
+}
+
+void main() {
+    tcGrid[gl_InvocationID] = vGrid[gl_InvocationID];
+
+    if (gl_InvocationID == 0) {
+        vec4 c0 = corner_clip(0);
+        vec4 c1 = corner_clip(1);
+        vec4 c2 = corner_clip(2);
+        vec4 c3 = corner_clip(3);
+
+        // Drop patches entirely behind the camera or beside the frustum.
+        bool behind = c0.w <= 0.0 && c1.w <= 0.0 && c2.w <= 0.0 && c3.w <= 0.0;
+        bool left = c0.x < -c0.w && c1.x < -c1.w && c2.x < -c2.w && c3.x < -c3.w;
+        bool right = c0.x > c0.w && c1.x > c1.w && c2.x > c2.w && c3.x > c3.w;
+        if (behind || left || right) {
+            gl_TessLevelOuter[0] = gl_TessLevelOuter[1] = gl_TessLevelOuter[2] = gl_TessLevelOuter[3] = 0.0;
+            gl_TessLevelInner[0] = gl_TessLevelInner[1] = 0.0;
+            return;
+        }
+
+        // Quad edges: 0 is u = 0, 1 is v = 0, 2 is u = 1, 3 is v = 1.
+        gl_TessLevelOuter[0] = edge_level(c0, c3);
+        gl_TessLevelOuter[1] = edge_level(c0, c1);
+        gl_TessLevelOuter[2] = edge_level(c1, c2);
+        gl_TessLevelOuter[3] = edge_level(c3, c2);
+        gl_TessLevelInner[0] = max(gl_TessLevelOuter[1], gl_TessLevelOuter[3]);
+        gl_TessLevelInner[1] = max(gl_TessLevelOuter[0], gl_TessLevelOuter[2]);
+    }
+}
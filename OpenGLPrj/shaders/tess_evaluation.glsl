@@ -0,0 +1,32 @@
+#version 400 core
+
+layout(quads, fractional_even_spacing, ccw) in;
+
+in vec2 tcGrid[];
+
+out vec3 outColor;
+out vec2 TexCoord;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform sampler2D perlinTexture;
+uniform vec2 gridSize;
+uniform float gridSpacing;
+uniform float heightScale;
+uniform float maxHeight;
+
+void main() {
+    float u = gl_TessCoord.x;
+    float v = gl_TessCoord.y;
+    vec2 grid = mix(mix(tcGrid[0], tcGrid[1], u), mix(tcGrid[3], tcGrid[2], u), v);
+
+    float h = textureLod(perlinTexture, (grid + 0.5) / gridSize, 0.0).r * heightScale;
+    gl_Position = projection * view * model * vec4(grid.x * gridSpacing, h, grid.y * gridSpacing, 1.0);
+
+    // Same colour ramp as Terrain::generate_vertices.
+    float t = clamp(h / maxHeight, 0.0, 1.0);
+    outColor = mix(vec3(0.2, 0.9, 0.2), vec3(0.5, 0.5, 0.5), t);
+    TexCoord = grid / gridSize;
+}
@@ -0,0 +1,10 @@
+#version 400 core
+
+// Patch corner in heightfield sample coordinates.
+layout(location = 0) in vec2 aGrid;
+
+out vec2 vGrid;
+
+void main() {
+    vGrid = aGrid;
+}
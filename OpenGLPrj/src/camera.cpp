@@ -69,6 +69,12 @@ void Camera::process_mouse_scroll(float y_offset) {
         zoom = ZOOM;
 }
 
+void Camera::set_orientation(float yaw, float pitch) {
+    this->yaw = yaw;
+    this->pitch = pitch;
+    update_camera_vectors();
+}
+
 void Camera::update_camera_vectors() {
     glm::vec3 new_front;
     new_front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
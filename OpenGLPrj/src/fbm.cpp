@@ -0,0 +1,55 @@
+#include "fbm.hpp"
+
+#include <algorithm>
+
+Fbm_Weights make_fbm_weights(int octaves, float persistence) {
+    Fbm_Weights weights;
+    weights.octaves = std::max(1, std::min(octaves, FBM_MAX_OCTAVES));
+    float amplitude = 1.0f;
+    float total = 0.0f;
+    for (int i = 0; i < FBM_MAX_OCTAVES; i++) {
+        weights.amplitudes[i] = i < weights.octaves ? amplitude : 0.0f;
+        total += weights.amplitudes[i];
+        amplitude *= persistence;
+    }
+    weights.normalization = 1.0f / total;
+    return weights;
+}
+
+template <typename Backend>
+static float fbm_loop(float x, float y, const Fbm_Weights& weights) {
+    float total = 0.0f;
+    float frequency = 1.0f;
+    for (int i = 0; i < weights.octaves; i++) {
+        total += Backend::sample(x * frequency, y * frequency) * weights.amplitudes[i];
+        frequency *= 2.0f;
+    }
+    return total * weights.normalization;
+}
+
+template <typename Backend>
+static Fbm_Function select_octaves(int octaves) {
+    switch (octaves) {
+        case 1: return &fbm<1, Backend>;
+        case 2: return &fbm<2, Backend>;
+        case 3: return &fbm<3, Backend>;
+        case 4: return &fbm<4, Backend>;
+        case 5: return &fbm<5, Backend>;
+        case 6: return &fbm<6, Backend>;
+        case 7: return &fbm<7, Backend>;
+        case 8: return &fbm<8, Backend>;
+        case 9: return &fbm<9, Backend>;
+        case 10: return &fbm<10, Backend>;
+        case 11: return &fbm<11, Backend>;
+        case 12: return &fbm<12, Backend>;
+        default: return &fbm_loop<Backend>;
+    }
+}
+
+Fbm_Function select_fbm(Noise_Backend backend, const Fbm_Weights& weights) {
+    switch (backend) {
+        case SIMPLEX_NOISE: return select_octaves<Simplex_Backend>(weights.octaves);
+        case VALUE_NOISE: return select_octaves<Value_Backend>(weights.octaves);
+        default: return select_octaves<Perlin_Backend>(weights.octaves);
+    }
+}
@@ -0,0 +1,84 @@
+#include "gpu_generator.hpp"
+#include "perlin.hpp"
+#include "shader.hpp"
+#include "timer.hpp"
+#include "utils.hpp"
+
+#include <glad/glad.h>
+
+static const int GPU_GROUP_SIZE = 16;
+
+static void record_pass(std::vector<Stage_Timing>& timings, const char* name, double start_ms) {
+    glFinish();
+    Stage_Timing timing = {name, now_ms() - start_ms};
+    timings.push_back(timing);
+}
+
+Gpu_Generator::Gpu_Generator(const std::string& shader_dir)
+: perm_buffer(0), buffer_memory(MEMORY_GPU_BUFFERS), is_supported(false) {
+    int major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major < 4 || (major == 4 && minor < 3)) {
+        gl_log_err("log.log", "GPU terrain generation needs OpenGL 4.3, context is %d.%d\n", major, minor);
+        return;
+    }
+
+    noise_program.reset(new Shader((shader_dir + "compute_noise.glsl").c_str()));
+    mesh_program.reset(new Shader((shader_dir + "compute_mesh.glsl").c_str()));
+    if (!noise_program->valid() || !mesh_program->valid()) return;
+
+    glGenBuffers(1, &perm_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, perm_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(perlin_perm), perlin_perm, GL_STATIC_DRAW);
+    buffer_memory.set(sizeof(perlin_perm));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    is_supported = true;
+}
+
+Gpu_Generator::~Gpu_Generator() {
+    if (!perm_buffer) return;
+    glDeleteBuffers(1, &perm_buffer);
+}
+
+void Gpu_Generator::generate(const Gpu_Terrain_Params& params, unsigned int texture, unsigned int vbo, unsigned int ebo, std::vector<Stage_Timing>& timings) {
+    if (!is_supported) return;
+    int groups_x = (params.width + GPU_GROUP_SIZE - 1) / GPU_GROUP_SIZE;
+    int groups_y = (params.height + GPU_GROUP_SIZE - 1) / GPU_GROUP_SIZE;
+
+    double start = now_ms();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, perm_buffer);
+    glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+
+    Shader& noise = *noise_program;
+    noise.use();
+    noise.set_int("gridWidth", params.width);
+    noise.set_int("gridHeight", params.height);
+    noise.set_float("noiseScale", params.noise_scale);
+    noise.set_int("octaves", params.noise_octaves);
+    noise.set_float("persistence", params.noise_persistence);
+    noise.set_float("fieldFrequency", params.noise_scale * 0.2f);
+    glDispatchCompute(groups_x, groups_y, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    record_pass(timings, "gpu_noise", start);
+
+    if (vbo && ebo) {
+        start = now_ms();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, vbo);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, ebo);
+        Shader& mesh = *mesh_program;
+        mesh.use();
+        mesh.set_int("gridWidth", params.width);
+        mesh.set_int("gridHeight", params.height);
+        mesh.set_float("gridSpacing", params.scale);
+        mesh.set_float("displacement", params.displacement);
+        mesh.set_int("patchQuads", TERRAIN_PATCH_QUADS);
+        glDispatchCompute(groups_x, groups_y, 1);
+        glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        record_pass(timings, "gpu_mesh", start);
+    }
+
+    for (int i = 0; i < 5; i++) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+    glUseProgram(0);
+}
@@ -0,0 +1,554 @@
+#include "heightfield_codec.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CODEC_SSE2
+#include <emmintrin.h>
+#endif
+
+static const char CODEC_MAGIC[4] = {'H', 'F', 'C', '2'};
+static const int ESCAPE = 255;
+static const int SYMBOLS = 256;
+// Longest Huffman code; the decode tables have 1 << CODE_BITS entries.
+static const int CODE_BITS = 12;
+static const int TABLE_SIZE = 1 << CODE_BITS;
+static const int TABLE_MASK = TABLE_SIZE - 1;
+// A refill leaves at least 57 bits in the reader, enough for this many
+// lookups of up to CODE_BITS each.
+static const int LOOKUPS_PER_REFILL = 4;
+// Each block is coded as this many bitstreams over consecutive row bands, so
+// the decoder has independent dependency chains to overlap.
+static const int STREAMS = 4;
+
+// Header: magic, width, height, block_size, step, 256 code lengths, then
+// blocks_x * blocks_z + 1 offsets into the block payload area.
+static const size_t FIXED_HEADER_SIZE = 4 + 3 * 4 + 4 + SYMBOLS;
+
+static void put_u32(std::vector<unsigned char>& out, unsigned int v) {
+    for (int i = 0; i < 4; i++) out.push_back((unsigned char)(v >> (8 * i)));
+}
+
+static unsigned int get_u32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static inline unsigned long long get_u64(const unsigned char* p) {
+    return get_u32(p) | ((unsigned long long)get_u32(p + 4) << 32);
+}
+
+static inline unsigned int zigzag(int v) {
+    return ((unsigned int)v << 1) ^ (unsigned int)(v >> 31);
+}
+
+static inline int unzigzag(unsigned int v) {
+    return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+static inline int predict(const int* q, int stride, int x, int z) {
+    if (x == 0 && z == 0) return 0;
+    if (z == 0) return q[-1];
+    if (x == 0) return q[-stride];
+    return q[-1] + q[-stride] - q[-stride - 1];
+}
+
+static unsigned int reverse_bits(unsigned int code, int length) {
+    unsigned int reversed = 0;
+    for (int i = 0; i < length; i++, code >>= 1) reversed = (reversed << 1) | (code & 1);
+    return reversed;
+}
+
+// Huffman code lengths for the symbol counts, limited to CODE_BITS by
+// flattening the counts until the tree is shallow enough. Unused symbols get
+// length 0; at least two symbols are always coded so the code is complete.
+static void build_code_lengths(const std::vector<unsigned long long>& counts, std::vector<unsigned char>& lengths) {
+    typedef std::pair<unsigned long long, int> Node;
+    std::vector<unsigned long long> weights(counts);
+    for (;;) {
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node> > queue;
+        for (int s = 0; s < SYMBOLS; s++) {
+            if (weights[s]) queue.push(Node(weights[s], s));
+        }
+        if (queue.empty()) queue.push(Node(1, 0));
+        if (queue.size() == 1) queue.push(Node(1, queue.top().second == 0 ? 1 : 0));
+
+        // Internal nodes are numbered after the symbols, so every parent has
+        // a higher index than its children.
+        std::vector<int> parent(2 * SYMBOLS, -1);
+        int next = SYMBOLS;
+        while (queue.size() > 1) {
+            Node a = queue.top();
+            queue.pop();
+            Node b = queue.top();
+            queue.pop();
+            parent[a.second] = parent[b.second] = next;
+            queue.push(Node(a.first + b.first, next++));
+        }
+        std::vector<int> depth(next, 0);
+        for (int n = next - 2; n >= 0; n--) {
+            if (parent[n] >= 0) depth[n] = depth[parent[n]] + 1;
+        }
+
+        lengths.assign(SYMBOLS, 0);
+        int longest = 0;
+        for (int s = 0; s < SYMBOLS; s++) {
+            if (parent[s] < 0) continue;
+            lengths[s] = (unsigned char)depth[s];
+            longest = std::max(longest, depth[s]);
+        }
+        if (longest <= CODE_BITS) return;
+        for (int s = 0; s < SYMBOLS; s++) weights[s] = (weights[s] + 1) / 2;
+    }
+}
+
+// Canonical codes for the lengths, bit-reversed because the streams are
+// written and read least significant bit first.
+static void build_codes(const std::vector<unsigned char>& lengths, std::vector<unsigned int>& codes) {
+    codes.assign(SYMBOLS, 0);
+    unsigned int code = 0;
+    for (int length = 1; length <= CODE_BITS; length++) {
+        for (int s = 0; s < SYMBOLS; s++) {
+            if (lengths[s] == length) codes[s] = reverse_bits(code++, length);
+        }
+        code <<= 1;
+    }
+}
+
+struct Bit_Writer {
+    std::vector<unsigned char>& out;
+    unsigned long long bits;
+    int count;
+
+    explicit Bit_Writer(std::vector<unsigned char>& out) : out(out), bits(0), count(0) {}
+
+    void put(unsigned int code, int length) {
+        bits |= (unsigned long long)code << count;
+        for (count += length; count >= 8; count -= 8, bits >>= 8) out.push_back((unsigned char)bits);
+    }
+
+    void flush() {
+        if (count > 0) out.push_back((unsigned char)bits);
+        bits = 0;
+        count = 0;
+    }
+};
+
+// First row of a block band coded by `stream`; bands split the rows evenly.
+static int stream_row(int stream, int rows) {
+    return rows * stream / STREAMS;
+}
+
+std::vector<unsigned char> encode_heightfield(const float* heights, int width, int height, float tolerance, int block_size) {
+    if (!(tolerance > 0.0f)) {
+        fprintf(stderr, "ERROR: heightfield tolerance must be positive\n");
+        return std::vector<unsigned char>();
+    }
+    float step = 2.0f * tolerance;
+    float max_abs = 0.0f;
+    for (int i = 0; i < width * height; i++) {
+        if (!std::isfinite(heights[i])) {
+            fprintf(stderr, "ERROR: heightfield sample %d is not finite\n", i);
+            return std::vector<unsigned char>();
+        }
+        max_abs = std::max(max_abs, std::fabs(heights[i]));
+    }
+    if (max_abs / step > (float)HEIGHTFIELD_MAX_QUANTIZED) {
+        fprintf(stderr, "ERROR: heights up to %g need a tolerance of at least %g\n", max_abs, max_abs / HEIGHTFIELD_MAX_QUANTIZED / 2.0f);
+        return std::vector<unsigned char>();
+    }
+
+    int blocks_x = (width + block_size - 1) / block_size;
+    int blocks_z = (height + block_size - 1) / block_size;
+
+    // Quantise and turn into per-block residuals.
+    std::vector<int> quantized(width * height);
+    for (int i = 0; i < width * height; i++) quantized[i] = (int)std::lround(heights[i] / step);
+
+    std::vector<unsigned int> residuals(width * height);
+    std::vector<unsigned long long> counts(SYMBOLS, 0);
+    for (int bz = 0; bz < blocks_z; bz++) {
+        for (int bx = 0; bx < blocks_x; bx++) {
+            int x0 = bx * block_size, z0 = bz * block_size;
+            int x1 = std::min(x0 + block_size, width), z1 = std::min(z0 + block_size, height);
+            for (int z = z0; z < z1; z++) {
+                for (int x = x0; x < x1; x++) {
+                    const int* q = &quantized[z * width + x];
+                    unsigned int r = zigzag(q[0] - predict(q, width, x - x0, z - z0));
+                    residuals[z * width + x] = r;
+                    counts[std::min<unsigned int>(r, ESCAPE)]++;
+                }
+            }
+        }
+    }
+
+    std::vector<unsigned char> lengths;
+    std::vector<unsigned int> codes;
+    build_code_lengths(counts, lengths);
+    build_codes(lengths, codes);
+
+    std::vector<unsigned char> payload;
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned char> escapes;
+    std::vector<unsigned char> streams[STREAMS];
+    for (int bz = 0; bz < blocks_z; bz++) {
+        for (int bx = 0; bx < blocks_x; bx++) {
+            offsets.push_back((unsigned int)payload.size());
+            int x0 = bx * block_size, z0 = bz * block_size;
+            int x1 = std::min(x0 + block_size, width), z1 = std::min(z0 + block_size, height);
+
+            escapes.clear();
+            for (int k = 0; k < STREAMS; k++) {
+                streams[k].clear();
+                Bit_Writer writer(streams[k]);
+                for (int z = z0 + stream_row(k, z1 - z0); z < z0 + stream_row(k + 1, z1 - z0); z++) {
+                    for (int x = x0; x < x1; x++) {
+                        unsigned int r = residuals[z * width + x];
+                        int s = (int)std::min<unsigned int>(r, ESCAPE);
+                        writer.put(codes[s], lengths[s]);
+                        if (s != ESCAPE) continue;
+                        for (r -= ESCAPE; r >= 0x80; r >>= 7) escapes.push_back((unsigned char)(r | 0x80));
+                        escapes.push_back((unsigned char)r);
+                    }
+                }
+                writer.flush();
+            }
+
+            // Escapes, then the sizes of all but the last stream, then the streams.
+            put_u32(payload, (unsigned int)escapes.size());
+            payload.insert(payload.end(), escapes.begin(), escapes.end());
+            for (int k = 0; k + 1 < STREAMS; k++) put_u32(payload, (unsigned int)streams[k].size());
+            for (int k = 0; k < STREAMS; k++) payload.insert(payload.end(), streams[k].begin(), streams[k].end());
+        }
+    }
+    offsets.push_back((unsigned int)payload.size());
+
+    std::vector<unsigned char> out;
+    out.reserve(FIXED_HEADER_SIZE + offsets.size() * 4 + payload.size());
+    for (int i = 0; i < 4; i++) out.push_back((unsigned char)CODEC_MAGIC[i]);
+    put_u32(out, (unsigned int)width);
+    put_u32(out, (unsigned int)height);
+    put_u32(out, (unsigned int)block_size);
+    unsigned int step_bits;
+    memcpy(&step_bits, &step, 4);
+    put_u32(out, step_bits);
+    out.insert(out.end(), lengths.begin(), lengths.end());
+    for (unsigned int i = 0; i < offsets.size(); i++) put_u32(out, offsets[i]);
+    out.insert(out.end(), payload.begin(), payload.end());
+    return out;
+}
+
+Heightfield_Decoder::Heightfield_Decoder(const unsigned char* data, size_t size)
+: data(data), size(size), is_valid(false), width(0), height(0), block_size(0), blocks_x(0), blocks_z(0), step(0.0f) {
+    if (size < FIXED_HEADER_SIZE || memcmp(data, CODEC_MAGIC, 4) != 0) {
+        fprintf(stderr, "ERROR: not a compressed heightfield\n");
+        return;
+    }
+    width = (int)get_u32(data + 4);
+    height = (int)get_u32(data + 8);
+    block_size = (int)get_u32(data + 12);
+    unsigned int step_bits = get_u32(data + 16);
+    memcpy(&step, &step_bits, 4);
+    if (width <= 0 || height <= 0 || block_size <= 0) {
+        fprintf(stderr, "ERROR: corrupt heightfield header\n");
+        return;
+    }
+    blocks_x = (width + block_size - 1) / block_size;
+    blocks_z = (height + block_size - 1) / block_size;
+
+    // Single-symbol table: every CODE_BITS-bit window maps to the symbol its
+    // low bits start with. The code must be complete, so every entry is set.
+    const unsigned char* lengths = data + 20;
+    std::vector<unsigned int> codes;
+    std::vector<unsigned char> length_table(lengths, lengths + SYMBOLS);
+    unsigned int filled = 0;
+    for (int s = 0; s < SYMBOLS; s++) {
+        if (lengths[s] > CODE_BITS) filled = TABLE_SIZE + 1;
+        else if (lengths[s]) filled += TABLE_SIZE >> lengths[s];
+    }
+    if (filled != (unsigned int)TABLE_SIZE) {
+        fprintf(stderr, "ERROR: corrupt heightfield code table\n");
+        return;
+    }
+    build_codes(length_table, codes);
+    single.resize(TABLE_SIZE);
+    for (int s = 0; s < SYMBOLS; s++) {
+        for (unsigned int i = codes[s]; lengths[s] && i < (unsigned int)TABLE_SIZE; i += 1u << lengths[s]) {
+            Decode_Entry& entry = single[i];
+            entry.symbols[0] = (unsigned char)s;
+            entry.symbols[1] = entry.symbols[2] = 0;
+            entry.info = (unsigned char)(lengths[s] | (1 << 4));
+        }
+    }
+
+    // Run table: every window maps to as many whole codes (up to three) as
+    // fit in it, so one lookup usually decodes several small residuals.
+    runs.resize(TABLE_SIZE);
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        Decode_Entry& entry = runs[i];
+        int used = 0, count = 0;
+        memset(&entry, 0, sizeof(entry));
+        while (count < 3) {
+            const Decode_Entry& next = single[(i >> used) & TABLE_MASK];
+            int length = next.info & 15;
+            if (used + length > CODE_BITS) break;
+            entry.symbols[count++] = next.symbols[0];
+            used += length;
+        }
+        entry.info = (unsigned char)(used | (count << 4));
+    }
+
+    size_t block_count = (size_t)blocks_x * blocks_z;
+    size_t offsets_end = FIXED_HEADER_SIZE + (block_count + 1) * 4;
+    if (size < offsets_end) {
+        fprintf(stderr, "ERROR: truncated heightfield\n");
+        return;
+    }
+    block_offsets.resize(block_count + 1);
+    for (size_t i = 0; i <= block_count; i++) {
+        block_offsets[i] = get_u32(data + FIXED_HEADER_SIZE + i * 4);
+        if (offsets_end + block_offsets[i] > size || (i && block_offsets[i] < block_offsets[i - 1])) {
+            fprintf(stderr, "ERROR: corrupt heightfield block table\n");
+            return;
+        }
+    }
+    this->data = data + offsets_end;
+    is_valid = true;
+}
+
+bool Heightfield_Decoder::valid() const {
+    return is_valid;
+}
+
+int Heightfield_Decoder::get_width() const {
+    return width;
+}
+
+int Heightfield_Decoder::get_height() const {
+    return height;
+}
+
+int Heightfield_Decoder::get_block_size() const {
+    return block_size;
+}
+
+int Heightfield_Decoder::get_blocks_x() const {
+    return blocks_x;
+}
+
+int Heightfield_Decoder::get_blocks_z() const {
+    return blocks_z;
+}
+
+struct Bit_Reader {
+    const unsigned char* ptr;
+    const unsigned char* end;
+    unsigned int used;
+    unsigned char* out;
+    unsigned char* out_end;
+};
+
+// Symbols one refill of lookups can produce; the run table's three-symbol
+// entries are written as four bytes.
+static const int RUN_ROOM = LOOKUPS_PER_REFILL * 3 + 1;
+// Stream bytes a reader without RUN_ROOM symbols left can still need.
+static const int TAIL_BYTES = RUN_ROOM * CODE_BITS / 8 + 1;
+
+static inline bool has_room(const Bit_Reader& reader) {
+    return reader.end - reader.ptr >= 8 && reader.out_end - reader.out >= RUN_ROOM;
+}
+
+// One refill and LOOKUPS_PER_REFILL run table lookups; needs has_room().
+static inline void decode_runs(Bit_Reader& reader, const Decode_Entry* table) {
+    unsigned long long bits = get_u64(reader.ptr) >> reader.used;
+    unsigned int used = reader.used;
+    unsigned char* dst = reader.out;
+    for (int n = 0; n < LOOKUPS_PER_REFILL; n++) {
+        const Decode_Entry& entry = table[bits & TABLE_MASK];
+        memcpy(dst, &entry, 4);
+        unsigned int length = entry.info & 15;
+        dst += entry.info >> 4;
+        bits >>= length;
+        used += length;
+    }
+    reader.out = dst;
+    reader.ptr += used >> 3;
+    reader.used = used & 7;
+}
+
+// Decodes the last symbols one at a time from a zero-padded copy of the end
+// of the stream, checking that no code runs past it.
+static bool decode_tail(Bit_Reader& reader, const Decode_Entry* single) {
+    size_t size = reader.end - reader.ptr;
+    size_t copied = std::min<size_t>(size, TAIL_BYTES);
+    unsigned char tail[TAIL_BYTES + 8] = {0};
+    if (copied) memcpy(tail, reader.ptr, copied);
+    size_t position = reader.used;
+    while (reader.out < reader.out_end) {
+        if (position >= copied * 8) return false;
+        unsigned long long bits = get_u64(&tail[position >> 3]) >> (position & 7);
+        const Decode_Entry& entry = single[bits & TABLE_MASK];
+        *reader.out++ = entry.symbols[0];
+        position += entry.info & 15;
+    }
+    return position <= size * 8;
+}
+
+// Planar prediction along a row is a prefix sum of the residuals added to the
+// row above: row[x] = prev[x] + sum of unzigzag(residuals[0..x]). The first
+// row uses a zero row above. Writes both the quantised row, for the next
+// row's prediction, and the heights.
+#ifdef CODEC_SSE2
+static inline __m128i load_residuals(const int* residuals) {
+    return _mm_loadu_si128((const __m128i*)residuals);
+}
+
+static inline __m128i load_residuals(const unsigned char* residuals) {
+    int packed;
+    memcpy(&packed, residuals, 4);
+    __m128i zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+}
+#endif
+
+template <typename Residual>
+static void reconstruct_row(const Residual* residuals, const int* prev, int* row, float* dst, int n, float step) {
+    int x = 0;
+    int delta = 0;
+#ifdef CODEC_SSE2
+    __m128i one = _mm_set1_epi32(1);
+    __m128i carry = _mm_setzero_si128();
+    __m128 scale = _mm_set1_ps(step);
+    for (; x + 4 <= n; x += 4) {
+        __m128i r = load_residuals(residuals + x);
+        __m128i d = _mm_xor_si128(_mm_srli_epi32(r, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(r, one)));
+        d = _mm_add_epi32(d, _mm_slli_si128(d, 4));
+        d = _mm_add_epi32(d, _mm_slli_si128(d, 8));
+        d = _mm_add_epi32(d, carry);
+        carry = _mm_shuffle_epi32(d, _MM_SHUFFLE(3, 3, 3, 3));
+        __m128i v = _mm_add_epi32(d, _mm_loadu_si128((const __m128i*)(prev + x)));
+        _mm_storeu_si128((__m128i*)(row + x), v);
+        _mm_storeu_ps(dst + x, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+    delta = _mm_cvtsi128_si32(carry);
+#endif
+    for (; x < n; x++) {
+        delta += unzigzag(residuals[x]);
+        row[x] = prev[x] + delta;
+        dst[x] = row[x] * step;
+    }
+}
+
+bool Heightfield_Decoder::decode_block(int block_x, int block_z, float* out) const {
+    if (!is_valid || block_x < 0 || block_z < 0 || block_x >= blocks_x || block_z >= blocks_z) return false;
+
+    int index = block_z * blocks_x + block_x;
+    const unsigned char* ptr = data + block_offsets[index];
+    const unsigned char* end = data + block_offsets[index + 1];
+    if (end - ptr < 4) return false;
+    unsigned int escape_size = get_u32(ptr);
+    ptr += 4;
+    if ((size_t)(end - ptr) < escape_size + 4 * (STREAMS - 1)) return false;
+    const unsigned char* escapes = ptr;
+    const unsigned char* escapes_end = escapes + escape_size;
+    ptr = escapes_end;
+
+    int x0 = block_x * block_size, z0 = block_z * block_size;
+    int bw = std::min(block_size, width - x0), bh = std::min(block_size, height - z0);
+
+    // Entropy decode the whole block into bytes, then reconstruct it in one
+    // pass; a block of symbols stays in L1 cache between the two.
+    static thread_local std::vector<unsigned char> symbols;
+    symbols.resize((size_t)bw * bh);
+    Bit_Reader readers[STREAMS];
+    const unsigned char* stream = ptr + 4 * (STREAMS - 1);
+    for (int k = 0; k < STREAMS; k++) {
+        size_t stream_size = k + 1 < STREAMS ? get_u32(ptr + 4 * k) : end - stream;
+        if (stream_size > (size_t)(end - stream)) return false;
+        Bit_Reader& reader = readers[k];
+        reader.ptr = stream;
+        reader.end = stream + stream_size;
+        reader.used = 0;
+        reader.out = &symbols[0] + (size_t)stream_row(k, bh) * bw;
+        reader.out_end = &symbols[0] + (size_t)stream_row(k + 1, bh) * bw;
+        stream += stream_size;
+    }
+
+    // Lockstep over the streams while all of them have room, which overlaps
+    // their dependency chains; then finish each stream on its own.
+    const Decode_Entry* table = &runs[0];
+    for (;;) {
+        bool room = true;
+        for (int k = 0; k < STREAMS; k++) room = room && has_room(readers[k]);
+        if (!room) break;
+        for (int k = 0; k < STREAMS; k++) decode_runs(readers[k], table);
+    }
+    for (int k = 0; k < STREAMS; k++) {
+        while (has_room(readers[k])) decode_runs(readers[k], table);
+        if (!decode_tail(readers[k], &single[0])) return false;
+    }
+
+    // Planar prediction, with the first row and column predicted from their
+    // single neighbour, same as predict() on the encoder side. Escaped
+    // residuals are rare; only blocks that have any widen their symbols and
+    // patch them in from their own stream.
+    static thread_local std::vector<int> quantized;
+    quantized.resize(symbols.size());
+    int* q = &quantized[0];
+    if (escapes < escapes_end) {
+        for (size_t i = 0; i < symbols.size(); i++) {
+            q[i] = symbols[i];
+            if (q[i] != ESCAPE) continue;
+            unsigned int extra = 0;
+            for (int shift = 0;; shift += 7) {
+                if (escapes >= escapes_end || shift > 28) return false;
+                unsigned char byte = *escapes++;
+                extra |= (unsigned int)(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) break;
+            }
+            q[i] = (int)(ESCAPE + extra);
+        }
+        if (escapes != escapes_end) return false;
+    }
+
+    static thread_local std::vector<int> zero_row;
+    zero_row.assign(bw, 0);
+    const int* prev = &zero_row[0];
+    for (int z = 0; z < bh; z++) {
+        int* row = q + (size_t)z * bw;
+        float* dst = out + (size_t)(z0 + z) * width + x0;
+        if (escape_size) reconstruct_row(row, prev, row, dst, bw, step);
+        else reconstruct_row(&symbols[(size_t)z * bw], prev, row, dst, bw, step);
+        prev = row;
+    }
+    return true;
+}
+
+bool Heightfield_Decoder::decode(std::vector<float>& out, int threads) const {
+    if (!is_valid) return false;
+    out.resize((size_t)width * height);
+
+    int block_count = blocks_x * blocks_z;
+    threads = std::max(1, std::min(threads, block_count));
+    std::atomic<int> next_block(0);
+    std::atomic<bool> ok(true);
+    float* dst = &out[0];
+    auto worker = [&]() {
+        for (int i = next_block++; i < block_count; i = next_block++) {
+            if (!decode_block(i % blocks_x, i / blocks_x, dst)) ok = false;
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) pool.push_back(std::thread(worker));
+    worker();
+    for (unsigned int t = 0; t < pool.size(); t++) pool[t].join();
+    return ok;
+}
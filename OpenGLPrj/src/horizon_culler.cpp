@@ -0,0 +1,155 @@
+#include "horizon_culler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HORIZON_SSE2
+#include <emmintrin.h>
+#endif
+
+// Monotonic stand-in for atan2 on [0, 4) that needs no trigonometry. Bins are
+// not exactly equal in angle, which only changes their resolution.
+static float diamond_angle(float x, float z) {
+    float p = z / (std::fabs(x) + std::fabs(z));
+    if (x < 0.0f) return 2.0f - p;
+    if (z < 0.0f) return 4.0f + p;
+    return p;
+}
+
+// True if every bin is strictly above `slope`.
+static bool above_slope(const float* horizon, int count, float slope) {
+    int i = 0;
+#ifdef HORIZON_SSE2
+    __m128 s = _mm_set1_ps(slope);
+    for (; i + 4 <= count; i += 4) {
+        if (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(horizon + i), s))) return false;
+    }
+#endif
+    for (; i < count; i++) {
+        if (!(horizon[i] > slope)) return false;
+    }
+    return true;
+}
+
+static void raise_to_slope(float* horizon, int count, float slope) {
+    int i = 0;
+#ifdef HORIZON_SSE2
+    __m128 s = _mm_set1_ps(slope);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(horizon + i, _mm_max_ps(_mm_loadu_ps(horizon + i), s));
+    }
+#endif
+    for (; i < count; i++) horizon[i] = std::max(horizon[i], slope);
+}
+
+Horizon_Culler::Horizon_Culler(int bins)
+: bins(std::max(bins, 4)), horizon(std::max(bins, 4)), memory(MEMORY_CACHES) {
+    track_memory();
+}
+
+void Horizon_Culler::track_memory() {
+    memory.set((patches.capacity() + occluders.capacity()) * sizeof(Patch_Bounds) + horizon.capacity() * sizeof(float)
+               + order.capacity() * sizeof(order[0]) + pending.capacity() * sizeof(Occluder));
+}
+
+void Horizon_Culler::set_patches(const std::vector<Patch_Bounds>& patches, const std::vector<Patch_Bounds>& occluders) {
+    this->patches = patches;
+    this->occluders = occluders;
+    track_memory();
+}
+
+// Bins [first_bin, last_bin] (not yet wrapped) spanned by the patch as seen
+// from outside its footprint, where the span is always under half a turn.
+void Horizon_Culler::azimuth_bins(const Patch_Bounds& patch, float eye_x, float eye_z, int& first_bin, int& last_bin) const {
+    float center = diamond_angle((patch.min_x + patch.max_x) * 0.5f - eye_x, (patch.min_z + patch.max_z) * 0.5f - eye_z);
+    float corners_x[4] = {patch.min_x, patch.max_x, patch.min_x, patch.max_x};
+    float corners_z[4] = {patch.min_z, patch.min_z, patch.max_z, patch.max_z};
+    float lo = 0.0f, hi = 0.0f;
+    for (int i = 0; i < 4; i++) {
+        float delta = diamond_angle(corners_x[i] - eye_x, corners_z[i] - eye_z) - center;
+        if (delta >= 2.0f) delta -= 4.0f;
+        else if (delta < -2.0f) delta += 4.0f;
+        lo = std::min(lo, delta);
+        hi = std::max(hi, delta);
+    }
+    float to_bins = bins / 4.0f;
+    first_bin = (int)std::floor((center + lo) * to_bins);
+    last_bin = (int)std::floor((center + hi) * to_bins);
+}
+
+// Bins [first_bin, first_bin + count) wrap around, so they are visited as at
+// most two contiguous runs.
+bool Horizon_Culler::horizon_above(int first_bin, int count, float slope) const {
+    int start = (first_bin % bins + bins) % bins;
+    int head = std::min(count, bins - start);
+    return above_slope(&horizon[start], head, slope) && above_slope(&horizon[0], count - head, slope);
+}
+
+void Horizon_Culler::flush_occluders(float distance) {
+    while (!pending.empty() && pending.front().far_distance <= distance) {
+        const Occluder& occluder = pending.front();
+        int start = (occluder.first_bin % bins + bins) % bins;
+        int head = std::min(occluder.bin_count, bins - start);
+        raise_to_slope(&horizon[start], head, occluder.slope);
+        raise_to_slope(&horizon[0], occluder.bin_count - head, occluder.slope);
+        std::pop_heap(pending.begin(), pending.end());
+        pending.pop_back();
+    }
+}
+
+int Horizon_Culler::cull(float eye_x, float eye_y, float eye_z, std::vector<unsigned char>& visible) {
+    visible.assign(patches.size(), 1);
+    std::fill(horizon.begin(), horizon.end(), -std::numeric_limits<float>::infinity());
+    pending.clear();
+
+    // Patches are numbered first, then occluder cells.
+    int patch_count = (int)patches.size();
+    order.clear();
+    for (int i = 0; i < patch_count + (int)occluders.size(); i++) {
+        const Patch_Bounds& box = i < patch_count ? patches[i] : occluders[i - patch_count];
+        float dx = std::max(std::max(box.min_x - eye_x, eye_x - box.max_x), 0.0f);
+        float dz = std::max(std::max(box.min_z - eye_z, eye_z - box.max_z), 0.0f);
+        order.push_back(std::make_pair(std::sqrt(dx * dx + dz * dz), i));
+    }
+    std::sort(order.begin(), order.end());
+    track_memory();
+
+    int hidden = 0;
+    for (unsigned int n = 0; n < order.size(); n++) {
+        float near_distance = order[n].first;
+        bool is_patch = order[n].second < patch_count;
+        const Patch_Bounds& patch = is_patch ? patches[order[n].second] : occluders[order[n].second - patch_count];
+        // Occluders count only once they are entirely nearer than this patch.
+        flush_occluders(near_distance);
+        if (near_distance <= 0.0f) continue;
+
+        float dx = std::max(std::fabs(patch.min_x - eye_x), std::fabs(patch.max_x - eye_x));
+        float dz = std::max(std::fabs(patch.min_z - eye_z), std::fabs(patch.max_z - eye_z));
+        float far_distance = std::sqrt(dx * dx + dz * dz);
+
+        int first_bin, last_bin;
+        azimuth_bins(patch, eye_x, eye_z, first_bin, last_bin);
+        if (is_patch) {
+            // Steepest ray from the eye to any point of the patch.
+            float top = patch.max_y - eye_y;
+            float highest_slope = top > 0.0f ? top / near_distance : top / far_distance;
+            if (horizon_above(first_bin, last_bin - first_bin + 1, highest_slope)) {
+                visible[order[n].second] = 0;
+                hidden++;
+            }
+            continue;
+        }
+
+        // Any ray below this slope goes underground somewhere over the cell.
+        // Only bins wholly inside its azimuth range are crossed by it, and the
+        // cell is skipped if the horizon is already higher there.
+        float bottom = patch.min_y - eye_y;
+        Occluder occluder = {far_distance, first_bin + 1, last_bin - first_bin - 1, bottom > 0.0f ? bottom / far_distance : bottom / near_distance};
+        if (occluder.bin_count <= 0 || horizon_above(occluder.first_bin, occluder.bin_count, occluder.slope)) continue;
+        pending.push_back(occluder);
+        std::push_heap(pending.begin(), pending.end());
+    }
+    return hidden;
+}
@@ -0,0 +1,163 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+
+struct Job {
+    std::function<void()> work;
+    // Unfinished dependencies, plus one held by submit() while it registers them.
+    std::atomic<int> pending;
+    std::atomic<bool> done;
+    std::mutex mutex;
+    std::vector<Job_Handle> successors;
+};
+
+// Queue owned by the current thread; threads that do not belong to a system
+// (e.g. the main thread) share queue 0.
+static thread_local const Job_System* current_system = nullptr;
+static thread_local int current_index = 0;
+
+Job_System::Job_System(int thread_count)
+: queued(0), waiting(0), stopping(false) {
+    if (thread_count <= 0) thread_count = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 0; i < thread_count; i++) queues.push_back(std::unique_ptr<Worker_Queue>(new Worker_Queue()));
+    for (int i = 1; i < thread_count; i++) threads.push_back(std::thread(&Job_System::worker_loop, this, i));
+}
+
+Job_System::~Job_System() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (unsigned int i = 0; i < threads.size(); i++) threads[i].join();
+}
+
+int Job_System::get_thread_count() const {
+    return (int)queues.size();
+}
+
+int Job_System::current_queue() const {
+    return current_system == this ? current_index : 0;
+}
+
+void Job_System::push(const Job_Handle& job) {
+    Worker_Queue& queue = *queues[current_queue()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(job);
+    }
+    // Counted under the sleep mutex so a worker about to sleep cannot miss it.
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        queued++;
+    }
+    wake.notify_one();
+    if (waiting > 0) finished.notify_all();
+}
+
+Job_Handle Job_System::find_job(int queue) {
+    int count = (int)queues.size();
+    for (int i = 0; i < count; i++) {
+        Worker_Queue& victim = *queues[(queue + i) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.jobs.empty()) continue;
+
+        Job_Handle job;
+        if (i == 0) {
+            job = victim.jobs.back();
+            victim.jobs.pop_back();
+        } else {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+        }
+        queued--;
+        return job;
+    }
+    return Job_Handle();
+}
+
+void Job_System::run(const Job_Handle& job) {
+    job->work();
+    job->work = nullptr;
+
+    std::vector<Job_Handle> successors;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->done = true;
+        successors.swap(job->successors);
+    }
+    // Taking the sleep mutex orders this against a waiter that has checked
+    // `done` but not yet gone to sleep.
+    if (waiting > 0) {
+        { std::lock_guard<std::mutex> lock(sleep_mutex); }
+        finished.notify_all();
+    }
+    for (unsigned int i = 0; i < successors.size(); i++) {
+        if (--successors[i]->pending == 0) push(successors[i]);
+    }
+}
+
+void Job_System::worker_loop(int queue) {
+    current_system = this;
+    current_index = queue;
+    for (;;) {
+        Job_Handle job = find_job(queue);
+        if (job) {
+            run(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this]() { return stopping || queued > 0; });
+        if (stopping && queued == 0) return;
+    }
+}
+
+Job_Handle Job_System::submit(std::function<void()> work) {
+    return submit(work, std::vector<Job_Handle>());
+}
+
+Job_Handle Job_System::submit(std::function<void()> work, const std::vector<Job_Handle>& dependencies) {
+    Job_Handle job = std::make_shared<Job>();
+    job->work = work;
+    job->pending = 1;
+    job->done = false;
+    for (unsigned int i = 0; i < dependencies.size(); i++) {
+        Job& dependency = *dependencies[i];
+        std::lock_guard<std::mutex> lock(dependency.mutex);
+        if (dependency.done) continue;
+        dependency.successors.push_back(job);
+        job->pending++;
+    }
+    if (--job->pending == 0) push(job);
+    return job;
+}
+
+void Job_System::wait(const Job_Handle& job) {
+    int queue = current_queue();
+    while (!job->done) {
+        Job_Handle other = find_job(queue);
+        if (other) {
+            run(other);
+            continue;
+        }
+        waiting++;
+        {
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            finished.wait(lock, [this, &job]() { return job->done || queued > 0; });
+        }
+        waiting--;
+    }
+}
+
+void Job_System::parallel_for(int begin, int end, int grain, const std::function<void(int, int)>& body) {
+    if (begin >= end) return;
+    grain = std::max(grain, 1);
+    std::vector<Job_Handle> jobs;
+    for (int chunk = begin + grain; chunk < end; chunk += grain) {
+        int chunk_end = std::min(chunk + grain, end);
+        jobs.push_back(submit([&body, chunk, chunk_end]() { body(chunk, chunk_end); }));
+    }
+    // The first chunk runs here rather than waiting in a queue.
+    body(begin, std::min(begin + grain, end));
+    for (unsigned int i = 0; i < jobs.size(); i++) wait(jobs[i]);
+}
@@ -0,0 +1,54 @@
+#include "log.hpp"
+
+#include <fstream>
+#include <ctime>
+#include <cstdarg>
+#include <cstdio>
+
+bool restart_gl_log(const std::string& log_file_path) {
+    std::ofstream log_file(log_file_path.c_str(), std::ios::out | std::ios::trunc);
+    if (!log_file.is_open()) {
+        fprintf(stderr, "ERROR: Could not open log file %s for writing\n", log_file_path.c_str());
+        return false;
+    }
+    std::time_t now = std::time(nullptr);
+    std::string date = std::ctime(&now);
+    log_file << "GL_LOG_FILE log. Log started: " << date << std::endl;
+    log_file.close();
+    return true;
+}
+
+bool gl_log(const std::string& log_file_path, const char* message, ...) {
+    std::ofstream log_file(log_file_path.c_str(), std::ios::out | std::ios::app);
+    if (!log_file.is_open()) {
+        fprintf(stderr, "ERROR: Could not open log file %s for writing\n", log_file_path.c_str());
+        return false;
+    }
+    va_list args;
+    va_start(args, message);
+    char buffer[1024];
+    vsnprintf(buffer, sizeof(buffer), message, args);
+    va_end(args);
+    log_file << buffer << std::endl;
+    log_file.close();
+    return true;
+}
+
+bool gl_log_err(const std::string& log_file_path, const char* message, ...) {
+    std::ofstream log_file(log_file_path.c_str(), std::ios::out | std::ios::app);
+    if (!log_file.is_open()) {
+        fprintf(stderr, "ERROR: Could not open log file %s for writing\n", log_file_path.c_str());
+        return false;
+    }
+    va_list args;
+    va_start(args, message);
+    char buffer[1024];
+    vsnprintf(buffer, sizeof(buffer), message, args);
+    va_end(args);
+    log_file << "ERROR: " << buffer << std::endl;
+    va_start(args, message);
+    vfprintf(stderr, message, args);
+    va_end(args);
+    log_file.close();
+    return true;
+}
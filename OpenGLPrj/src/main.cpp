@@ -5,71 +5,383 @@
 #include "perlin.hpp"
 #include "camera.hpp"
 #include "terrain.hpp"
+#include "gpu_generator.hpp"
+#include "job_system.hpp"
+#include "replay.hpp"
+#include "perf_report.hpp"
+#include "timer.hpp"
+#include "memory_stats.hpp"
+#include "simulation.hpp"
 
 // System Headers
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 // Standard Headers
+#include <algorithm>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <limits>
+#include <memory>
 #include <string>
 #include <vector>
 
-int main() {
-    GLFWwindow* window;
-    if (!init_opengl(window, window_width, window_height, "OpenGLPrj")) return EXIT_FAILURE;
+// Target on-screen length of one tessellated edge segment.
+static const float TESSELLATION_PIXELS_PER_SEGMENT = 8.0f;
+
+// Terrain
+static const int TERRAIN_WIDTH = 512, TERRAIN_HEIGHT = 512;
+static const float TERRAIN_SCALE = 0.1f, TERRAIN_DISPLACEMENT = 20.0f;
+static const float NOISE_SCALE = 10.0f, NOISE_PERSISTENCE = 0.5f;
+static const int NOISE_OCTAVES = 4;
+
+// Largest accepted difference between the CPU and GPU heightfields, in
+// normalised height; vertex heights are compared at the same relative error.
+static const float GPU_HEIGHT_TOLERANCE = 1e-3f;
+
+static std::unique_ptr<Terrain> make_terrain(bool noise_multires, Job_System* jobs, Terrain_Render_Mode render_mode, Gpu_Generator* gpu_generator) {
+    return std::unique_ptr<Terrain>(new Terrain(TERRAIN_WIDTH, TERRAIN_HEIGHT, TERRAIN_SCALE, TERRAIN_DISPLACEMENT, NOISE_SCALE, NOISE_OCTAVES,
+                                                NOISE_PERSISTENCE, noise_multires, PERLIN_NOISE, jobs, render_mode, gpu_generator));
+}
+
+static void draw_scene(Shader& shader, Camera& camera, const Terrain& terrain, const Terrain_Draw_Ranges* ranges) {
+    // Background fill color
+    glClearColor(0.25f, 0.25f, 0.25f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Activate shader
+    shader.use();
+
+    glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), (float)window_width / (float)window_height, 0.1f, 100.0f);
+    shader.set_mat4("projection", projection);
+
+    glm::mat4 view = camera.get_view_matrix();
+    shader.set_mat4("view", view);
+
+    glm::mat4 model = glm::mat4(1.0f);
+    shader.set_mat4("model", model);
+
+    if (terrain.get_render_mode() == TERRAIN_TESSELLATED) {
+        shader.set_vec2("viewportSize", (float)window_width, (float)window_height);
+        shader.set_float("pixelsPerSegment", TESSELLATION_PIXELS_PER_SEGMENT);
+    }
 
+    terrain.render(ranges);
+}
+
+struct Run_Options {
+    bool replaying;
+    bool recording;
+    bool headless;
+    Terrain_Render_Mode render_mode;
+    bool multires;
+    bool gpu_generation;
+    bool horizon_cull;
+    std::string report_path;
+    // Memory stats: a file rewritten every stats_interval seconds, and/or a
+    // table printed on exit.
+    std::string stats_path;
+    double stats_interval;
+    bool print_stats;
+};
+
+// Called while the terrain is still alive so current sizes are meaningful.
+static bool finish_memory_stats(Memory_Stats_Writer& stats_writer, const Run_Options& options) {
+    if (options.print_stats) print_memory_stats(stdout);
+    return stats_writer.write();
+}
+
+// Owns every GL object so they are released before the context goes away.
+static int run(GLFWwindow* window, Replay& replay, const Run_Options& options) {
     Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
-    float delta_time = 0.0f;
-    float last_frame = 0.0f;
+    if (options.replaying) restore_camera_state(camera, replay.start);
 
-    configure_opengl(window, camera);
+    const std::string shader_dir = std::string(project_source_dir) + "/shaders/";
 
-    // Terrain
-    int terrain_width = 512, terrain_height = 512;
-    float terrain_scale = 0.1f, terrain_displacement = 20.0f;
-    float noise_scale = 10, noise_octaves = 4, noise_persistence = 0.5f;
-    Terrain terrain(terrain_width, terrain_height, terrain_scale, terrain_displacement, noise_scale, noise_octaves, noise_persistence);
+    // The GPU computes the exact field, so multires sampling only applies to
+    // CPU generation.
+    std::unique_ptr<Gpu_Generator> gpu_generator;
+    if (options.gpu_generation) gpu_generator.reset(new Gpu_Generator(shader_dir));
+    Job_System jobs;
+    std::unique_ptr<Terrain> terrain_ptr = make_terrain(options.multires && !options.gpu_generation, &jobs, options.render_mode, gpu_generator.get());
+    Terrain& terrain = *terrain_ptr;
     terrain.upload_to_gpu();
 
-    const std::string vertex_shader_path = std::string(project_source_dir) + "/shaders/vertex.glsl";
-    const std::string fragment_shader_path = std::string(project_source_dir) + "/shaders/fragment.glsl";
+    Memory_Stats_Writer stats_writer(options.stats_path, options.stats_interval);
+    stats_writer.write();
 
-    Shader shader(vertex_shader_path.c_str(), fragment_shader_path.c_str());
+    const std::string fragment_shader_path = shader_dir + "fragment.glsl";
+
+    std::unique_ptr<Shader> shader_program;
+    if (options.render_mode == TERRAIN_TESSELLATED) {
+        shader_program.reset(new Shader((shader_dir + "tess_vertex.glsl").c_str(), (shader_dir + "tess_control.glsl").c_str(),
+                                        (shader_dir + "tess_evaluation.glsl").c_str(), fragment_shader_path.c_str()));
+    } else {
+        shader_program.reset(new Shader((shader_dir + "vertex.glsl").c_str(), fragment_shader_path.c_str()));
+    }
+    Shader& shader = *shader_program;
     shader.use();
     shader.set_int("texture1", 0);
+    if (options.render_mode == TERRAIN_TESSELLATED) terrain.set_tessellation_uniforms(shader);
 
-    // Rendering loop
-    while (!glfwWindowShouldClose(window)) {
-        float current_frame = (float)glfwGetTime();
-        delta_time = current_frame - last_frame;
-        last_frame = current_frame;
+    if (options.replaying) {
+        // Deterministic replay: one fixed simulation step per frame, with the
+        // GPU drained every frame so frame times include rendering cost.
+        Perf_Report report;
+        const std::vector<Stage_Timing>& setup = terrain.get_stage_timings();
+        for (unsigned int i = 0; i < setup.size(); i++) report.add_setup(setup[i].name, setup[i].ms);
 
-        process_input(window, camera, delta_time);
+        // Primitives reaching the rasteriser (after tessellation) and GPU time.
+        unsigned int queries[2];
+        glGenQueries(2, queries);
 
-        // Background fill color
-        glClearColor(0.25f, 0.25f, 0.25f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        float max_drift = 0.0f;
+        Terrain_Draw_Ranges ranges;
+        for (unsigned int i = 0; i < replay.ticks.size(); i++) {
+            double frame_start = now_ms();
+            apply_input(camera, replay.ticks[i].input, replay.timestep);
+            max_drift = std::max(max_drift, camera_state_drift(capture_camera_state(camera), replay.ticks[i].camera));
+            double input_end = now_ms();
 
-        // Activate shader
-        shader.use();
+            if (options.horizon_cull) {
+                float rejected = terrain.cull_hidden_patches(camera.position.x, camera.position.y, camera.position.z, ranges);
+                report.add_sample("cull_rejected", rejected);
+            }
+            double cull_end = now_ms();
+            if (options.horizon_cull) report.add_sample("cull", cull_end - input_end);
 
-        glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), (float)window_width / (float)window_height, 0.1f, 100.0f);
-        shader.set_mat4("projection", projection);
+            glBeginQuery(GL_PRIMITIVES_GENERATED, queries[0]);
+            glBeginQuery(GL_TIME_ELAPSED, queries[1]);
+            draw_scene(shader, camera, terrain, &ranges);
+            glEndQuery(GL_TIME_ELAPSED);
+            glEndQuery(GL_PRIMITIVES_GENERATED);
+            double submit_end = now_ms();
+            glFinish();
+            double frame_end = now_ms();
 
-        glm::mat4 view = camera.get_view_matrix();
-        shader.set_mat4("view", view);
+            GLuint64 triangles = 0, gpu_ns = 0;
+            glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &triangles);
+            glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &gpu_ns);
+            report.add_sample("triangles", (double)triangles);
+            report.add_sample("gpu_time", gpu_ns / 1e6);
 
-        glm::mat4 model = glm::mat4(1.0f);
-        shader.set_mat4("model", model);
+            report.add_sample("input", input_end - frame_start);
+            report.add_sample("render_submit", submit_end - cull_end);
+            report.add_sample("gpu_wait", frame_end - submit_end);
+            report.add_sample("frame", frame_end - frame_start);
 
-        terrain.render();
+            if (window) {
+                glfwSwapBuffers(window);
+                glfwPollEvents();
+            }
+            stats_writer.poll();
+        }
+
+        glDeleteQueries(2, queries);
+
+        report.set_value("frames", (double)replay.ticks.size());
+        report.set_value("headless", options.headless ? 1.0 : 0.0);
+        report.set_value("tessellated", options.render_mode == TERRAIN_TESSELLATED ? 1.0 : 0.0);
+        report.set_value("gpu_generation", terrain.generated_on_gpu() ? 1.0 : 0.0);
+        report.set_value("horizon_cull", options.horizon_cull ? 1.0 : 0.0);
+        report.set_value("geometry_bytes", (double)terrain.get_geometry_bytes());
+        report.set_value("camera_max_drift", max_drift);
+        for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+            report.set_value(std::string("memory_peak_") + memory_tag_name((Memory_Tag)tag), (double)memory_stats((Memory_Tag)tag).peak);
+        }
+        printf("replayed %u frames (%s): p50 %.3f ms, p99 %.3f ms, p50 %.0f triangles, camera drift %g\n", (unsigned int)replay.ticks.size(),
+               options.render_mode == TERRAIN_TESSELLATED ? "tessellated" : "mesh", report.percentile("frame", 50), report.percentile("frame", 99),
+               report.percentile("triangles", 50), max_drift);
+        if (options.horizon_cull) {
+            printf("horizon culling: p50 %.1f%% of triangles rejected, cull p50 %.3f ms, p99 %.3f ms\n", 100.0 * report.percentile("cull_rejected", 50),
+                   report.percentile("cull", 50), report.percentile("cull", 99));
+        }
+        if (!finish_memory_stats(stats_writer, options)) return EXIT_FAILURE;
+        if (!options.report_path.empty() && !report.write_json(options.report_path)) return EXIT_FAILURE;
+        return EXIT_SUCCESS;
+    }
+
+    // Interactive loop: the camera runs at a fixed timestep on the simulation
+    // thread, so a recording replays identically regardless of the frame rate
+    // it was captured at. This thread only pumps GLFW events (which must stay
+    // on the main thread) and renders the newest snapshot, interpolated to the
+    // present time. Horizon culling runs on the simulation thread as well, from
+    // each tick's camera, and its draw ranges arrive with the snapshot.
+    Simulation simulation(camera, FIXED_TIMESTEP, options.recording ? &replay : nullptr, options.horizon_cull ? &terrain : nullptr);
+    simulation.start();
+
+    // Input latency is measured from the poll of the newest active input a
+    // snapshot includes to the return of the swap that first presents it.
+    Perf_Report report;
+    Camera render_camera = camera;
+    unsigned int presented_sequence = 0;
+    unsigned int frames = 0;
+    double last_present = 0.0;
+    while (!glfwWindowShouldClose(window)) {
+        glfwPollEvents();
+        simulation.push_input(poll_input(window));
+
+        const Camera_Snapshot& snapshot = simulation.latest_snapshot();
+        float alpha = snapshot_alpha(snapshot, now_ms(), FIXED_TIMESTEP);
+        restore_camera_state(render_camera, interpolate_camera_state(snapshot.previous, snapshot.current, alpha));
+
+        draw_scene(shader, render_camera, terrain, &snapshot.draw_ranges);
 
         // Flip buffers and draw
         glfwSwapBuffers(window);
-        glfwPollEvents();
-    }   
-    glfwTerminate();
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+        double present = now_ms();
+        if (last_present > 0.0) report.add_sample("frame_interval", present - last_present);
+        last_present = present;
+        frames++;
+        if (snapshot.input_sequence != presented_sequence) {
+            report.add_sample("input_latency", present - snapshot.input_ms);
+            presented_sequence = snapshot.input_sequence;
+        }
+        stats_writer.poll();
+    }
+    simulation.stop();
+
+    report.set_value("ticks", (double)simulation.latest_snapshot().tick);
+    report.set_value("frames", (double)frames);
+    printf("frame pacing: p50 %.3f ms, p99 %.3f ms; input latency: p50 %.3f ms, p99 %.3f ms\n", report.percentile("frame_interval", 50),
+           report.percentile("frame_interval", 99), report.percentile("input_latency", 50), report.percentile("input_latency", 99));
+    if (!options.report_path.empty() && !report.write_json(options.report_path)) return EXIT_FAILURE;
+    return finish_memory_stats(stats_writer, options) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static float max_abs_difference(const std::vector<float>& a, const std::vector<float>& b) {
+    if (a.size() != b.size()) return std::numeric_limits<float>::infinity();
+    float max_error = 0.0f;
+    for (unsigned int i = 0; i < a.size(); i++) max_error = std::max(max_error, std::fabs(a[i] - b[i]));
+    return max_error;
+}
+
+// Builds the exact (non-multires) terrain on the CPU and in compute shaders,
+// reads both back from GL and compares them; prints the stage timings side by
+// side. Succeeds when every sample is within GPU_HEIGHT_TOLERANCE.
+static int validate_gpu_generation(const std::string& report_path) {
+    const std::string shader_dir = std::string(project_source_dir) + "/shaders/";
+    Gpu_Generator generator(shader_dir);
+    if (!generator.supported()) {
+        fprintf(stderr, "ERROR: GPU generation needs OpenGL 4.3 compute shaders\n");
+        return EXIT_FAILURE;
+    }
+
+    Job_System jobs;
+    double start = now_ms();
+    std::unique_ptr<Terrain> cpu_terrain = make_terrain(false, &jobs, TERRAIN_MESH, nullptr);
+    cpu_terrain->upload_to_gpu();
+    glFinish();
+    double cpu_ms = now_ms() - start;
+
+    start = now_ms();
+    std::unique_ptr<Terrain> gpu_terrain = make_terrain(false, nullptr, TERRAIN_MESH, &generator);
+    gpu_terrain->upload_to_gpu();
+    double gpu_ms = now_ms() - start;
+
+    std::vector<float> cpu_heights, gpu_heights, cpu_vertices, gpu_vertices;
+    std::vector<unsigned int> cpu_indices, gpu_indices;
+    cpu_terrain->read_back(cpu_heights, cpu_vertices, cpu_indices);
+    gpu_terrain->read_back(gpu_heights, gpu_vertices, gpu_indices);
+
+    float height_error = max_abs_difference(cpu_heights, gpu_heights);
+    float vertex_error = max_abs_difference(cpu_vertices, gpu_vertices);
+    float vertex_tolerance = GPU_HEIGHT_TOLERANCE * TERRAIN_SCALE * TERRAIN_DISPLACEMENT * 2.0f;
+    bool indices_match = cpu_indices == gpu_indices;
+    bool passed = height_error <= GPU_HEIGHT_TOLERANCE && vertex_error <= vertex_tolerance && indices_match;
+
+    const std::vector<Stage_Timing>& cpu_stages = cpu_terrain->get_stage_timings();
+    const std::vector<Stage_Timing>& gpu_stages = gpu_terrain->get_stage_timings();
+    printf("terrain %d x %d, %d octaves, %d CPU threads\n", TERRAIN_WIDTH, TERRAIN_HEIGHT, NOISE_OCTAVES, jobs.get_thread_count());
+    printf("%-16s %10s   %-16s %10s\n", "cpu stage", "ms", "gpu stage", "ms");
+    for (unsigned int i = 0; i < std::max(cpu_stages.size(), gpu_stages.size()); i++) {
+        if (i < cpu_stages.size()) printf("%-16s %10.2f   ", cpu_stages[i].name.c_str(), cpu_stages[i].ms);
+        else printf("%-16s %10s   ", "", "");
+        if (i < gpu_stages.size()) printf("%-16s %10.2f", gpu_stages[i].name.c_str(), gpu_stages[i].ms);
+        printf("\n");
+    }
+    printf("%-16s %10.2f   %-16s %10.2f\n", "total", cpu_ms, "total", gpu_ms);
+    printf("max height error %g (tolerance %g), max vertex error %g (tolerance %g), indices %s: %s\n", height_error,
+           GPU_HEIGHT_TOLERANCE, vertex_error, vertex_tolerance, indices_match ? "identical" : "MISMATCH", passed ? "PASS" : "FAIL");
+
+    if (!report_path.empty()) {
+        Perf_Report report;
+        for (unsigned int i = 0; i < cpu_stages.size(); i++) report.add_setup("cpu_" + cpu_stages[i].name, cpu_stages[i].ms);
+        for (unsigned int i = 0; i < gpu_stages.size(); i++) report.add_setup("gpu_" + gpu_stages[i].name, gpu_stages[i].ms);
+        report.add_setup("cpu_total", cpu_ms);
+        report.add_setup("gpu_total", gpu_ms);
+        report.set_value("max_height_error", height_error);
+        report.set_value("max_vertex_error", vertex_error);
+        report.set_value("indices_match", indices_match ? 1.0 : 0.0);
+        report.set_value("passed", passed ? 1.0 : 0.0);
+        if (!report.write_json(report_path)) return EXIT_FAILURE;
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr, "usage: %s [--tessellation] [--multires] [--gpu-generation] [--horizon-cull] [--stats] [--stats-file FILE.json|FILE.prom [--stats-interval SECONDS]]\n"
+                    "       [--record FILE] [--report FILE.json] [--replay FILE [--headless]]\n"
+                    "       %s --validate-gpu [--report FILE.json] [--headless]\n", program, program);
+}
+
+int main(int argc, char** argv) {
+    std::string record_path;
+    std::string replay_path;
+    bool validate_gpu = false;
+    Run_Options options;
+    options.headless = false;
+    options.render_mode = TERRAIN_MESH;
+    options.multires = false;
+    options.gpu_generation = false;
+    options.horizon_cull = false;
+    options.stats_interval = 5.0;
+    options.print_stats = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) record_path = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replay_path = argv[++i];
+        else if (arg == "--report" && i + 1 < argc) options.report_path = argv[++i];
+        else if (arg == "--headless") options.headless = true;
+        else if (arg == "--tessellation") options.render_mode = TERRAIN_TESSELLATED;
+        else if (arg == "--multires") options.multires = true;
+        else if (arg == "--gpu-generation") options.gpu_generation = true;
+        else if (arg == "--validate-gpu") validate_gpu = true;
+        else if (arg == "--horizon-cull") options.horizon_cull = true;
+        else if (arg == "--stats") options.print_stats = true;
+        else if (arg == "--stats-file" && i + 1 < argc) options.stats_path = argv[++i];
+        else if (arg == "--stats-interval" && i + 1 < argc) options.stats_interval = atof(argv[++i]);
+        else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    options.replaying = !replay_path.empty();
+    options.recording = !record_path.empty();
+    if ((options.replaying && options.recording) || (options.headless && !options.replaying && !validate_gpu)
+        || (validate_gpu && (options.replaying || options.recording)) || options.stats_interval <= 0.0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Replay replay;
+    if (options.replaying && !load_replay(replay_path, replay)) return EXIT_FAILURE;
+    if ((options.replaying || validate_gpu) && !display_available()) options.headless = true;
+
+    GLFWwindow* window;
+    if (options.headless) {
+        if (!init_opengl_headless(window, window_width, window_height)) return EXIT_FAILURE;
+    } else {
+        if (!init_opengl(window, window_width, window_height, "OpenGLPrj")) return EXIT_FAILURE;
+        configure_opengl(window);
+    }
+
+    int result;
+    if (validate_gpu) result = validate_gpu_generation(options.report_path);
+    else result = run(window, replay, options);
+    if (options.recording && result == EXIT_SUCCESS && !save_replay(record_path, replay)) result = EXIT_FAILURE;
+    shutdown_opengl(window);
+    return result;
+}
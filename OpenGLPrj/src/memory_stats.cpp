@@ -0,0 +1,161 @@
+#include "memory_stats.hpp"
+#include "timer.hpp"
+
+#include <atomic>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+struct Tag_Counters {
+    std::atomic<long long> current;
+    std::atomic<long long> peak;
+    std::atomic<long long> live_trackers;
+    std::atomic<long long> resizes;
+};
+
+// Zero-initialised before any dynamic initialisation, so trackers in other
+// static objects are safe.
+static Tag_Counters counters[MEMORY_TAG_COUNT];
+
+static const char* tag_names[MEMORY_TAG_COUNT] = {"noise", "mesh", "gpu_buffers", "textures", "caches"};
+
+const char* memory_tag_name(Memory_Tag tag) {
+    return tag_names[tag];
+}
+
+bool memory_tag_on_gpu(Memory_Tag tag) {
+    return tag == MEMORY_GPU_BUFFERS || tag == MEMORY_TEXTURES;
+}
+
+Memory_Tag_Stats memory_stats(Memory_Tag tag) {
+    Memory_Tag_Stats stats = {counters[tag].current, counters[tag].peak, counters[tag].live_trackers, counters[tag].resizes};
+    return stats;
+}
+
+size_t estimate_texture_bytes(int width, int height, int bytes_per_texel, bool mipmaps) {
+    size_t total = 0;
+    for (;;) {
+        total += (size_t)width * height * bytes_per_texel;
+        if (!mipmaps || (width == 1 && height == 1)) return total;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+}
+
+Memory_Tracker::Memory_Tracker(Memory_Tag tag)
+: tag(tag), bytes(0) {
+}
+
+Memory_Tracker::~Memory_Tracker() {
+    set(0);
+}
+
+void Memory_Tracker::set(size_t new_bytes) {
+    if (new_bytes == bytes) return;
+    Tag_Counters& tag_counters = counters[tag];
+    if (bytes == 0) tag_counters.live_trackers++;
+    else if (new_bytes == 0) tag_counters.live_trackers--;
+    if (new_bytes != 0) tag_counters.resizes++;
+
+    long long current = tag_counters.current += (long long)new_bytes - (long long)bytes;
+    long long peak = tag_counters.peak;
+    while (current > peak && !tag_counters.peak.compare_exchange_weak(peak, current)) {}
+    bytes = new_bytes;
+}
+
+size_t Memory_Tracker::get() const {
+    return bytes;
+}
+
+static void write_prometheus(FILE* file) {
+    const char* metrics[4][3] = {
+        {"openglprj_memory_bytes", "gauge", "Bytes currently held per subsystem."},
+        {"openglprj_memory_peak_bytes", "gauge", "Most bytes ever held at once per subsystem."},
+        {"openglprj_memory_live_trackers", "gauge", "Trackers currently holding memory per subsystem."},
+        {"openglprj_memory_resizes_total", "counter", "Size changes reported to trackers per subsystem."}
+    };
+    for (int m = 0; m < 4; m++) {
+        fprintf(file, "# HELP %s %s\n# TYPE %s %s\n", metrics[m][0], metrics[m][2], metrics[m][0], metrics[m][1]);
+        for (int t = 0; t < MEMORY_TAG_COUNT; t++) {
+            Memory_Tag_Stats stats = memory_stats((Memory_Tag)t);
+            long long values[4] = {stats.current, stats.peak, stats.live_trackers, stats.resizes};
+            fprintf(file, "%s{tag=\"%s\",device=\"%s\"} %lld\n", metrics[m][0], tag_names[t], memory_tag_on_gpu((Memory_Tag)t) ? "gpu" : "cpu", values[m]);
+        }
+    }
+}
+
+static void write_json(FILE* file) {
+    long long totals[2] = {0, 0};
+    fprintf(file, "{\n  \"tags\": {");
+    for (int t = 0; t < MEMORY_TAG_COUNT; t++) {
+        Memory_Tag_Stats stats = memory_stats((Memory_Tag)t);
+        bool gpu = memory_tag_on_gpu((Memory_Tag)t);
+        totals[gpu ? 1 : 0] += stats.current;
+        fprintf(file, "%s\n    \"%s\": {\"device\": \"%s\", \"current\": %lld, \"peak\": %lld, \"live_trackers\": %lld, \"resizes\": %lld}", t ? "," : "",
+                tag_names[t], gpu ? "gpu" : "cpu", stats.current, stats.peak, stats.live_trackers, stats.resizes);
+    }
+    fprintf(file, "\n  },\n  \"cpu_current\": %lld,\n  \"gpu_current\": %lld\n}\n", totals[0], totals[1]);
+}
+
+// rename() on Windows refuses to replace an existing file, and the stats file
+// is rewritten in place every interval.
+static bool replace_file(const std::string& temp_path, const std::string& path) {
+#ifdef _WIN32
+    return MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+}
+
+bool write_memory_stats(const std::string& path) {
+    std::string temp_path = path + ".tmp";
+    FILE* file = fopen(temp_path.c_str(), "w");
+    if (!file) {
+        fprintf(stderr, "ERROR: Could not open stats file %s for writing\n", temp_path.c_str());
+        return false;
+    }
+    bool prometheus = path.size() >= 5 && path.compare(path.size() - 5, 5, ".prom") == 0;
+    if (prometheus) write_prometheus(file);
+    else write_json(file);
+    bool ok = fclose(file) == 0;
+    if (ok) ok = replace_file(temp_path, path);
+    if (!ok) {
+        remove(temp_path.c_str());
+        fprintf(stderr, "ERROR: Could not write stats file %s\n", path.c_str());
+    }
+    return ok;
+}
+
+void print_memory_stats(FILE* file) {
+    long long totals[2] = {0, 0};
+    long long peaks[2] = {0, 0};
+    fprintf(file, "%-12s %-4s %12s %12s %8s %8s\n", "memory", "", "current", "peak", "trackers", "resizes");
+    for (int t = 0; t < MEMORY_TAG_COUNT; t++) {
+        Memory_Tag_Stats stats = memory_stats((Memory_Tag)t);
+        bool gpu = memory_tag_on_gpu((Memory_Tag)t);
+        totals[gpu ? 1 : 0] += stats.current;
+        peaks[gpu ? 1 : 0] += stats.peak;
+        fprintf(file, "%-12s %-4s %9.2f MiB %8.2f MiB %8lld %8lld\n", tag_names[t], gpu ? "gpu" : "cpu", stats.current / 1048576.0, stats.peak / 1048576.0,
+                stats.live_trackers, stats.resizes);
+    }
+    // Per-tag peaks may fall at different times, so their sum bounds the real peak.
+    fprintf(file, "%-12s %-4s %9.2f MiB %8.2f MiB\n", "total", "cpu", totals[0] / 1048576.0, peaks[0] / 1048576.0);
+    fprintf(file, "%-12s %-4s %9.2f MiB %8.2f MiB\n", "total", "gpu", totals[1] / 1048576.0, peaks[1] / 1048576.0);
+}
+
+Memory_Stats_Writer::Memory_Stats_Writer(const std::string& path, double interval_s)
+: path(path), interval_ms(interval_s * 1000.0), next_ms(0.0) {
+}
+
+void Memory_Stats_Writer::poll() {
+    if (path.empty() || now_ms() < next_ms) return;
+    write();
+}
+
+bool Memory_Stats_Writer::write() {
+    if (path.empty()) return true;
+    next_ms = now_ms() + interval_ms;
+    return write_memory_stats(path);
+}
@@ -0,0 +1,782 @@
+#include "noise.hpp"
+#include "perlin.hpp"
+
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NOISE_SSE2
+#include <emmintrin.h>
+#endif
+
+static const float SIMPLEX_F2 = 0.36602540378f;
+static const float SIMPLEX_G2 = 0.21132486540f;
+static const float SIMPLEX_F3 = 1.0f / 3.0f;
+static const float SIMPLEX_G3 = 1.0f / 6.0f;
+
+static const float simplex_grad[12][3] = {
+    { 1,  1,  0}, {-1,  1,  0}, { 1, -1,  0}, {-1, -1,  0},
+    { 1,  0,  1}, {-1,  0,  1}, { 1,  0, -1}, {-1,  0, -1},
+    { 0,  1,  1}, { 0, -1,  1}, { 0,  1, -1}, { 0, -1, -1}
+};
+
+static inline int hash2(int i, int j) {
+    return perlin_perm[(i + perlin_perm[j & 255]) & 255];
+}
+
+static inline int hash3(int i, int j, int k) {
+    return perlin_perm[(i + perlin_perm[(j + perlin_perm[k & 255]) & 255]) & 255];
+}
+
+static inline float hash_value(int hash) {
+    return hash * (2.0f / 255.0f) - 1.0f;
+}
+
+float simplex_noise(float x, float y) {
+    float s = (x + y) * SIMPLEX_F2;
+    int i = fast_floor(x + s);
+    int j = fast_floor(y + s);
+    float t = (i + j) * SIMPLEX_G2;
+    float x0 = x - (i - t);
+    float y0 = y - (j - t);
+
+    int i1 = x0 > y0 ? 1 : 0;
+    int j1 = x0 > y0 ? 0 : 1;
+
+    float x1 = x0 - i1 + SIMPLEX_G2;
+    float y1 = y0 - j1 + SIMPLEX_G2;
+    float x2 = x0 - 1.0f + 2.0f * SIMPLEX_G2;
+    float y2 = y0 - 1.0f + 2.0f * SIMPLEX_G2;
+
+    const float* g0 = simplex_grad[hash2(i, j) % 12];
+    const float* g1 = simplex_grad[hash2(i + i1, j + j1) % 12];
+    const float* g2 = simplex_grad[hash2(i + 1, j + 1) % 12];
+
+    float n = 0.0f;
+    float t0 = 0.5f - x0 * x0 - y0 * y0;
+    if (t0 > 0.0f) {
+        t0 *= t0;
+        n += t0 * t0 * (g0[0] * x0 + g0[1] * y0);
+    }
+    float t1 = 0.5f - x1 * x1 - y1 * y1;
+    if (t1 > 0.0f) {
+        t1 *= t1;
+        n += t1 * t1 * (g1[0] * x1 + g1[1] * y1);
+    }
+    float t2 = 0.5f - x2 * x2 - y2 * y2;
+    if (t2 > 0.0f) {
+        t2 *= t2;
+        n += t2 * t2 * (g2[0] * x2 + g2[1] * y2);
+    }
+    return 70.0f * n;
+}
+
+float simplex_noise(float x, float y, float z) {
+    float s = (x + y + z) * SIMPLEX_F3;
+    int i = fast_floor(x + s);
+    int j = fast_floor(y + s);
+    int k = fast_floor(z + s);
+    float t = (i + j + k) * SIMPLEX_G3;
+    float x0 = x - (i - t);
+    float y0 = y - (j - t);
+    float z0 = z - (k - t);
+
+    int i1, j1, k1, i2, j2, k2;
+    if (x0 >= y0) {
+        if (y0 >= z0)      { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+        else if (x0 >= z0) { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 0; k2 = 1; }
+        else               { i1 = 0; j1 = 0; k1 = 1; i2 = 1; j2 = 0; k2 = 1; }
+    } else {
+        if (y0 < z0)       { i1 = 0; j1 = 0; k1 = 1; i2 = 0; j2 = 1; k2 = 1; }
+        else if (x0 < z0)  { i1 = 0; j1 = 1; k1 = 0; i2 = 0; j2 = 1; k2 = 1; }
+        else               { i1 = 0; j1 = 1; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+    }
+
+    float corners[4][3] = {
+        {x0, y0, z0},
+        {x0 - i1 + SIMPLEX_G3, y0 - j1 + SIMPLEX_G3, z0 - k1 + SIMPLEX_G3},
+        {x0 - i2 + 2.0f * SIMPLEX_G3, y0 - j2 + 2.0f * SIMPLEX_G3, z0 - k2 + 2.0f * SIMPLEX_G3},
+        {x0 - 1.0f + 3.0f * SIMPLEX_G3, y0 - 1.0f + 3.0f * SIMPLEX_G3, z0 - 1.0f + 3.0f * SIMPLEX_G3}
+    };
+    int hashes[4] = {
+        hash3(i, j, k),
+        hash3(i + i1, j + j1, k + k1),
+        hash3(i + i2, j + j2, k + k2),
+        hash3(i + 1, j + 1, k + 1)
+    };
+
+    float n = 0.0f;
+    for (int c = 0; c < 4; c++) {
+        const float* p = corners[c];
+        float tc = 0.6f - p[0] * p[0] - p[1] * p[1] - p[2] * p[2];
+        if (tc > 0.0f) {
+            const float* g = simplex_grad[hashes[c] % 12];
+            tc *= tc;
+            n += tc * tc * (g[0] * p[0] + g[1] * p[1] + g[2] * p[2]);
+        }
+    }
+    return 32.0f * n;
+}
+
+float value_noise(float x, float y) {
+    int X = fast_floor(x);
+    int Y = fast_floor(y);
+    float u = fade(x - X);
+    float v = fade(y - Y);
+
+    float v00 = hash_value(hash2(X, Y));
+    float v10 = hash_value(hash2(X + 1, Y));
+    float v01 = hash_value(hash2(X, Y + 1));
+    float v11 = hash_value(hash2(X + 1, Y + 1));
+
+    return lerp(v, lerp(u, v00, v10), lerp(u, v01, v11));
+}
+
+float value_noise(float x, float y, float z) {
+    int X = fast_floor(x);
+    int Y = fast_floor(y);
+    int Z = fast_floor(z);
+    float u = fade(x - X);
+    float v = fade(y - Y);
+    float w = fade(z - Z);
+
+    float near_plane = lerp(v, lerp(u, hash_value(hash3(X, Y, Z)), hash_value(hash3(X + 1, Y, Z))),
+                               lerp(u, hash_value(hash3(X, Y + 1, Z)), hash_value(hash3(X + 1, Y + 1, Z))));
+    float far_plane = lerp(v, lerp(u, hash_value(hash3(X, Y, Z + 1)), hash_value(hash3(X + 1, Y, Z + 1))),
+                              lerp(u, hash_value(hash3(X, Y + 1, Z + 1)), hash_value(hash3(X + 1, Y + 1, Z + 1))));
+    return lerp(w, near_plane, far_plane);
+}
+
+#ifdef NOISE_SSE2
+static inline __m128 floor_ps(__m128 v) {
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmplt_ps(v, t), _mm_set1_ps(1.0f)));
+}
+
+static inline __m128 fade_ps(__m128 t) {
+    __m128 inner = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f));
+    return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+}
+
+static inline __m128 lerp_ps(__m128 t, __m128 a, __m128 b) {
+    return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+static inline __m128 select_ps(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 grad_ps(__m128i hash, __m128 x, __m128 y) {
+    __m128i h = _mm_and_si128(hash, _mm_set1_epi32(15));
+    __m128 u_mask = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(8)));
+    __m128 v_mask = _mm_castsi128_ps(_mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)), _mm_cmpeq_epi32(h, _mm_set1_epi32(14))));
+    __m128 sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31));
+    return _mm_xor_ps(_mm_add_ps(select_ps(u_mask, x, y), select_ps(v_mask, x, y)), sign);
+}
+
+static inline __m128 grad_ps(__m128i hash, __m128 x, __m128 y, __m128 z) {
+    __m128i h = _mm_and_si128(hash, _mm_set1_epi32(15));
+    __m128 u_mask = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(8)));
+    __m128 y_mask = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+    __m128 x_mask = _mm_castsi128_ps(_mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)), _mm_cmpeq_epi32(h, _mm_set1_epi32(14))));
+    __m128 u = select_ps(u_mask, x, y);
+    __m128 v = select_ps(y_mask, y, select_ps(x_mask, x, z));
+    __m128 u_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31));
+    __m128 v_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30));
+    return _mm_add_ps(_mm_xor_ps(u, u_sign), _mm_xor_ps(v, v_sign));
+}
+
+static inline __m128 simplex_corner_ps(__m128 x, __m128 y, __m128 gx, __m128 gy) {
+    __m128 t = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(0.5f), _mm_mul_ps(x, x)), _mm_mul_ps(y, y));
+    t = _mm_max_ps(t, _mm_setzero_ps());
+    t = _mm_mul_ps(t, t);
+    return _mm_mul_ps(_mm_mul_ps(t, t), _mm_add_ps(_mm_mul_ps(gx, x), _mm_mul_ps(gy, y)));
+}
+static inline __m128 simplex_corner_ps(__m128 x, __m128 y, __m128 z, const float* g) {
+    __m128 t = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(0.6f), _mm_mul_ps(x, x)), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+    t = _mm_max_ps(t, _mm_setzero_ps());
+    t = _mm_mul_ps(t, t);
+    __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(g), x), _mm_mul_ps(_mm_load_ps(g + 4), y)), _mm_mul_ps(_mm_load_ps(g + 8), z));
+    return _mm_mul_ps(_mm_mul_ps(t, t), dot);
+}
+#endif
+
+void NoiseSource::sample_batch(const float* x, const float* y, float* out, int count) const {
+    for (int i = 0; i < count; i++) out[i] = sample(x[i], y[i]);
+}
+
+void NoiseSource::sample_batch(const float* x, const float* y, const float* z, float* out, int count) const {
+    for (int i = 0; i < count; i++) out[i] = sample(x[i], y[i], z[i]);
+}
+
+const char* PerlinNoiseSource::name() const {
+    return "perlin";
+}
+
+float PerlinNoiseSource::sample(float x, float y) const {
+    return perlin_noise(x, y);
+}
+
+// grad() only produces the gradients +-(1, 1) and +-(0, 2). Over every corner
+// combination the third derivative peaks at 150 on the cell edges, where
+// fade''' reaches 60 and the gradient difference 2.5.
+float PerlinNoiseSource::third_derivative_bound() const {
+    return 150.0f;
+}
+
+float PerlinNoiseSource::sample(float x, float y, float z) const {
+    return perlin_noise(x, y, z);
+}
+
+void PerlinNoiseSource::sample_batch(const float* x, const float* y, float* out, int count) const {
+    int i = 0;
+#ifdef NOISE_SSE2
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 fx = floor_ps(px);
+        __m128 fy = floor_ps(py);
+
+        // The permutation lookups are gathers; SSE2 has none, so do them per lane.
+        alignas(16) int cx[4], cy[4], haa[4], hab[4], hba[4], hbb[4];
+        _mm_store_si128((__m128i*)cx, _mm_cvttps_epi32(fx));
+        _mm_store_si128((__m128i*)cy, _mm_cvttps_epi32(fy));
+        for (int k = 0; k < 4; k++) {
+            int X = cx[k] & 255;
+            int Y = cy[k] & 255;
+            int a = perlin_perm[X] + Y;
+            int b = perlin_perm[(X + 1) & 255] + Y;
+            haa[k] = perlin_perm[a & 255];
+            hab[k] = perlin_perm[(a + 1) & 255];
+            hba[k] = perlin_perm[b & 255];
+            hbb[k] = perlin_perm[(b + 1) & 255];
+        }
+
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 tx = _mm_sub_ps(px, fx);
+        __m128 ty = _mm_sub_ps(py, fy);
+        __m128 tx1 = _mm_sub_ps(tx, one);
+        __m128 ty1 = _mm_sub_ps(ty, one);
+        __m128 u = fade_ps(tx);
+        __m128 v = fade_ps(ty);
+
+        __m128 gaa = grad_ps(_mm_load_si128((const __m128i*)haa), tx, ty);
+        __m128 gab = grad_ps(_mm_load_si128((const __m128i*)hab), tx, ty1);
+        __m128 gba = grad_ps(_mm_load_si128((const __m128i*)hba), tx1, ty);
+        __m128 gbb = grad_ps(_mm_load_si128((const __m128i*)hbb), tx1, ty1);
+
+        _mm_storeu_ps(out + i, lerp_ps(v, lerp_ps(u, gaa, gba), lerp_ps(u, gab, gbb)));
+    }
+#endif
+    for (; i < count; i++) out[i] = perlin_noise(x[i], y[i]);
+}
+
+void PerlinNoiseSource::sample_batch(const float* x, const float* y, const float* z, float* out, int count) const {
+    int i = 0;
+#ifdef NOISE_SSE2
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pz = _mm_loadu_ps(z + i);
+        __m128 fx = floor_ps(px);
+        __m128 fy = floor_ps(py);
+        __m128 fz = floor_ps(pz);
+
+        // Corner hashes, indexed by (dx, dy, dz) as bits 0, 1, 2.
+        alignas(16) int cx[4], cy[4], cz[4], h[8][4];
+        _mm_store_si128((__m128i*)cx, _mm_cvttps_epi32(fx));
+        _mm_store_si128((__m128i*)cy, _mm_cvttps_epi32(fy));
+        _mm_store_si128((__m128i*)cz, _mm_cvttps_epi32(fz));
+        for (int k = 0; k < 4; k++) {
+            int X = cx[k] & 255;
+            int Y = cy[k] & 255;
+            int Z = cz[k] & 255;
+            int a = perlin_perm[X] + Y;
+            int b = perlin_perm[(X + 1) & 255] + Y;
+            int aa = perlin_perm[a & 255] + Z;
+            int ab = perlin_perm[(a + 1) & 255] + Z;
+            int ba = perlin_perm[b & 255] + Z;
+            int bb = perlin_perm[(b + 1) & 255] + Z;
+            h[0][k] = perlin_perm[aa & 255];
+            h[1][k] = perlin_perm[ba & 255];
+            h[2][k] = perlin_perm[ab & 255];
+            h[3][k] = perlin_perm[bb & 255];
+            h[4][k] = perlin_perm[(aa + 1) & 255];
+            h[5][k] = perlin_perm[(ba + 1) & 255];
+            h[6][k] = perlin_perm[(ab + 1) & 255];
+            h[7][k] = perlin_perm[(bb + 1) & 255];
+        }
+
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 tx = _mm_sub_ps(px, fx);
+        __m128 ty = _mm_sub_ps(py, fy);
+        __m128 tz = _mm_sub_ps(pz, fz);
+        __m128 tx1 = _mm_sub_ps(tx, one);
+        __m128 ty1 = _mm_sub_ps(ty, one);
+        __m128 tz1 = _mm_sub_ps(tz, one);
+        __m128 u = fade_ps(tx);
+        __m128 v = fade_ps(ty);
+        __m128 w = fade_ps(tz);
+
+        __m128 x1 = lerp_ps(u, grad_ps(_mm_load_si128((const __m128i*)h[0]), tx, ty, tz), grad_ps(_mm_load_si128((const __m128i*)h[1]), tx1, ty, tz));
+        __m128 x2 = lerp_ps(u, grad_ps(_mm_load_si128((const __m128i*)h[2]), tx, ty1, tz), grad_ps(_mm_load_si128((const __m128i*)h[3]), tx1, ty1, tz));
+        __m128 x3 = lerp_ps(u, grad_ps(_mm_load_si128((const __m128i*)h[4]), tx, ty, tz1), grad_ps(_mm_load_si128((const __m128i*)h[5]), tx1, ty, tz1));
+        __m128 x4 = lerp_ps(u, grad_ps(_mm_load_si128((const __m128i*)h[6]), tx, ty1, tz1), grad_ps(_mm_load_si128((const __m128i*)h[7]), tx1, ty1, tz1));
+        _mm_storeu_ps(out + i, lerp_ps(w, lerp_ps(v, x1, x2), lerp_ps(v, x3, x4)));
+    }
+#endif
+    for (; i < count; i++) out[i] = perlin_noise(x[i], y[i], z[i]);
+}
+
+const char* SimplexNoiseSource::name() const {
+    return "simplex";
+}
+
+float SimplexNoiseSource::sample(float x, float y) const {
+    return simplex_noise(x, y);
+}
+
+// At most three corner kernels (0.5 - r^2)^4 (g . d) overlap; along an axis
+// each has a third derivative of at most 3, at its centre. Scaled by 70.
+float SimplexNoiseSource::third_derivative_bound() const {
+    return 3.0f * 3.0f * 70.0f;
+}
+
+float SimplexNoiseSource::sample(float x, float y, float z) const {
+    return simplex_noise(x, y, z);
+}
+
+void SimplexNoiseSource::sample_batch(const float* x, const float* y, float* out, int count) const {
+    int i = 0;
+#ifdef NOISE_SSE2
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 s = _mm_mul_ps(_mm_add_ps(px, py), _mm_set1_ps(SIMPLEX_F2));
+        __m128 fi = floor_ps(_mm_add_ps(px, s));
+        __m128 fj = floor_ps(_mm_add_ps(py, s));
+        __m128 t = _mm_mul_ps(_mm_add_ps(fi, fj), _mm_set1_ps(SIMPLEX_G2));
+        __m128 x0 = _mm_sub_ps(px, _mm_sub_ps(fi, t));
+        __m128 y0 = _mm_sub_ps(py, _mm_sub_ps(fj, t));
+
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 upper = _mm_cmpgt_ps(x0, y0);
+        __m128 i1 = _mm_and_ps(upper, one);
+        __m128 j1 = _mm_andnot_ps(upper, one);
+        __m128 g2 = _mm_set1_ps(SIMPLEX_G2);
+        __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, i1), g2);
+        __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, j1), g2);
+        __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, one), _mm_add_ps(g2, g2));
+        __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, one), _mm_add_ps(g2, g2));
+
+        alignas(16) int ci[4], cj[4], ui[4];
+        alignas(16) float gx[3][4], gy[3][4];
+        _mm_store_si128((__m128i*)ci, _mm_cvttps_epi32(fi));
+        _mm_store_si128((__m128i*)cj, _mm_cvttps_epi32(fj));
+        _mm_store_si128((__m128i*)ui, _mm_castps_si128(upper));
+        for (int k = 0; k < 4; k++) {
+            int di = ui[k] ? 1 : 0;
+            const float* c0 = simplex_grad[hash2(ci[k], cj[k]) % 12];
+            const float* c1 = simplex_grad[hash2(ci[k] + di, cj[k] + 1 - di) % 12];
+            const float* c2 = simplex_grad[hash2(ci[k] + 1, cj[k] + 1) % 12];
+            gx[0][k] = c0[0]; gy[0][k] = c0[1];
+            gx[1][k] = c1[0]; gy[1][k] = c1[1];
+            gx[2][k] = c2[0]; gy[2][k] = c2[1];
+        }
+
+        __m128 n = simplex_corner_ps(x0, y0, _mm_load_ps(gx[0]), _mm_load_ps(gy[0]));
+        n = _mm_add_ps(n, simplex_corner_ps(x1, y1, _mm_load_ps(gx[1]), _mm_load_ps(gy[1])));
+        n = _mm_add_ps(n, simplex_corner_ps(x2, y2, _mm_load_ps(gx[2]), _mm_load_ps(gy[2])));
+        _mm_storeu_ps(out + i, _mm_mul_ps(n, _mm_set1_ps(70.0f)));
+    }
+#endif
+    for (; i < count; i++) out[i] = simplex_noise(x[i], y[i]);
+}
+
+void SimplexNoiseSource::sample_batch(const float* x, const float* y, const float* z, float* out, int count) const {
+    int i = 0;
+#ifdef NOISE_SSE2
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pz = _mm_loadu_ps(z + i);
+        __m128 s = _mm_mul_ps(_mm_add_ps(_mm_add_ps(px, py), pz), _mm_set1_ps(SIMPLEX_F3));
+        __m128 fi = floor_ps(_mm_add_ps(px, s));
+        __m128 fj = floor_ps(_mm_add_ps(py, s));
+        __m128 fk = floor_ps(_mm_add_ps(pz, s));
+        __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(fi, fj), fk), _mm_set1_ps(SIMPLEX_G3));
+        __m128 x0 = _mm_sub_ps(px, _mm_sub_ps(fi, t));
+        __m128 y0 = _mm_sub_ps(py, _mm_sub_ps(fj, t));
+        __m128 z0 = _mm_sub_ps(pz, _mm_sub_ps(fk, t));
+
+        // Branch-free form of the scalar corner ordering.
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 xy = _mm_cmpge_ps(x0, y0);
+        __m128 yz = _mm_cmpge_ps(y0, z0);
+        __m128 xz = _mm_cmpge_ps(x0, z0);
+        __m128 m_i1 = _mm_and_ps(xy, xz);
+        __m128 m_j1 = _mm_andnot_ps(xy, yz);
+        __m128 m_k1 = _mm_andnot_ps(_mm_or_ps(xz, yz), _mm_castsi128_ps(_mm_set1_epi32(-1)));
+        __m128 m_i2 = _mm_or_ps(xy, xz);
+        __m128 m_j2 = _mm_or_ps(_mm_andnot_ps(xy, _mm_castsi128_ps(_mm_set1_epi32(-1))), yz);
+        __m128 m_k2 = _mm_andnot_ps(_mm_and_ps(xz, yz), _mm_castsi128_ps(_mm_set1_epi32(-1)));
+
+        __m128 g1 = _mm_set1_ps(SIMPLEX_G3);
+        __m128 g2 = _mm_set1_ps(2.0f * SIMPLEX_G3);
+        __m128 g3 = _mm_set1_ps(3.0f * SIMPLEX_G3);
+        __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, _mm_and_ps(m_i1, one)), g1);
+        __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, _mm_and_ps(m_j1, one)), g1);
+        __m128 z1 = _mm_add_ps(_mm_sub_ps(z0, _mm_and_ps(m_k1, one)), g1);
+        __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, _mm_and_ps(m_i2, one)), g2);
+        __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, _mm_and_ps(m_j2, one)), g2);
+        __m128 z2 = _mm_add_ps(_mm_sub_ps(z0, _mm_and_ps(m_k2, one)), g2);
+        __m128 x3 = _mm_add_ps(_mm_sub_ps(x0, one), g3);
+        __m128 y3 = _mm_add_ps(_mm_sub_ps(y0, one), g3);
+        __m128 z3 = _mm_add_ps(_mm_sub_ps(z0, one), g3);
+
+        alignas(16) int ci[4], cj[4], ck[4], o1[3][4], o2[3][4];
+        // Per corner: gradient x, y and z components for the four lanes.
+        alignas(16) float g[4][12];
+        _mm_store_si128((__m128i*)ci, _mm_cvttps_epi32(fi));
+        _mm_store_si128((__m128i*)cj, _mm_cvttps_epi32(fj));
+        _mm_store_si128((__m128i*)ck, _mm_cvttps_epi32(fk));
+        _mm_store_si128((__m128i*)o1[0], _mm_cvttps_epi32(_mm_and_ps(m_i1, one)));
+        _mm_store_si128((__m128i*)o1[1], _mm_cvttps_epi32(_mm_and_ps(m_j1, one)));
+        _mm_store_si128((__m128i*)o1[2], _mm_cvttps_epi32(_mm_and_ps(m_k1, one)));
+        _mm_store_si128((__m128i*)o2[0], _mm_cvttps_epi32(_mm_and_ps(m_i2, one)));
+        _mm_store_si128((__m128i*)o2[1], _mm_cvttps_epi32(_mm_and_ps(m_j2, one)));
+        _mm_store_si128((__m128i*)o2[2], _mm_cvttps_epi32(_mm_and_ps(m_k2, one)));
+        for (int k = 0; k < 4; k++) {
+            const float* corners[4] = {
+                simplex_grad[hash3(ci[k], cj[k], ck[k]) % 12],
+                simplex_grad[hash3(ci[k] + o1[0][k], cj[k] + o1[1][k], ck[k] + o1[2][k]) % 12],
+                simplex_grad[hash3(ci[k] + o2[0][k], cj[k] + o2[1][k], ck[k] + o2[2][k]) % 12],
+                simplex_grad[hash3(ci[k] + 1, cj[k] + 1, ck[k] + 1) % 12]
+            };
+            for (int c = 0; c < 4; c++) {
+                g[c][k] = corners[c][0];
+                g[c][4 + k] = corners[c][1];
+                g[c][8 + k] = corners[c][2];
+            }
+        }
+
+        __m128 n = simplex_corner_ps(x0, y0, z0, g[0]);
+        n = _mm_add_ps(n, simplex_corner_ps(x1, y1, z1, g[1]));
+        n = _mm_add_ps(n, simplex_corner_ps(x2, y2, z2, g[2]));
+        n = _mm_add_ps(n, simplex_corner_ps(x3, y3, z3, g[3]));
+        _mm_storeu_ps(out + i, _mm_mul_ps(n, _mm_set1_ps(32.0f)));
+    }
+#endif
+    for (; i < count; i++) out[i] = simplex_noise(x[i], y[i], z[i]);
+}
+
+const char* ValueNoiseSource::name() const {
+    return "value";
+}
+
+float ValueNoiseSource::sample(float x, float y) const {
+    return value_noise(x, y);
+}
+
+// fade() blends corner values in [-1, 1], and fade''' peaks at 60.
+float ValueNoiseSource::third_derivative_bound() const {
+    return 60.0f * 2.0f;
+}
+
+float ValueNoiseSource::sample(float x, float y, float z) const {
+    return value_noise(x, y, z);
+}
+
+void ValueNoiseSource::sample_batch(const float* x, const float* y, float* out, int count) const {
+    int i = 0;
+#ifdef NOISE_SSE2
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 fx = floor_ps(px);
+        __m128 fy = floor_ps(py);
+
+        alignas(16) int cx[4], cy[4];
+        alignas(16) float v00[4], v10[4], v01[4], v11[4];
+        _mm_store_si128((__m128i*)cx, _mm_cvttps_epi32(fx));
+        _mm_store_si128((__m128i*)cy, _mm_cvttps_epi32(fy));
+        for (int k = 0; k < 4; k++) {
+            v00[k] = hash_value(hash2(cx[k], cy[k]));
+            v10[k] = hash_value(hash2(cx[k] + 1, cy[k]));
+            v01[k] = hash_value(hash2(cx[k], cy[k] + 1));
+            v11[k] = hash_value(hash2(cx[k] + 1, cy[k] + 1));
+        }
+
+        __m128 u = fade_ps(_mm_sub_ps(px, fx));
+        __m128 v = fade_ps(_mm_sub_ps(py, fy));
+        __m128 bottom = lerp_ps(u, _mm_load_ps(v00), _mm_load_ps(v10));
+        __m128 top = lerp_ps(u, _mm_load_ps(v01), _mm_load_ps(v11));
+        _mm_storeu_ps(out + i, lerp_ps(v, bottom, top));
+    }
+#endif
+    for (; i < count; i++) out[i] = value_noise(x[i], y[i]);
+}
+
+void ValueNoiseSource::sample_batch(const float* x, const float* y, const float* z, float* out, int count) const {
+    int i = 0;
+#ifdef NOISE_SSE2
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pz = _mm_loadu_ps(z + i);
+        __m128 fx = floor_ps(px);
+        __m128 fy = floor_ps(py);
+        __m128 fz = floor_ps(pz);
+
+        // Corner values, indexed by (dx, dy, dz) as bits 0, 1, 2.
+        alignas(16) int cx[4], cy[4], cz[4];
+        alignas(16) float c[8][4];
+        _mm_store_si128((__m128i*)cx, _mm_cvttps_epi32(fx));
+        _mm_store_si128((__m128i*)cy, _mm_cvttps_epi32(fy));
+        _mm_store_si128((__m128i*)cz, _mm_cvttps_epi32(fz));
+        // hash3 with the z and y lookups shared between corners.
+        for (int k = 0; k < 4; k++) {
+            for (int dz = 0; dz < 2; dz++) {
+                int pz = perlin_perm[(cz[k] + dz) & 255];
+                for (int dy = 0; dy < 2; dy++) {
+                    int pyz = perlin_perm[(cy[k] + dy + pz) & 255];
+                    c[dz * 4 + dy * 2][k] = hash_value(perlin_perm[(cx[k] + pyz) & 255]);
+                    c[dz * 4 + dy * 2 + 1][k] = hash_value(perlin_perm[(cx[k] + 1 + pyz) & 255]);
+                }
+            }
+        }
+
+        __m128 u = fade_ps(_mm_sub_ps(px, fx));
+        __m128 v = fade_ps(_mm_sub_ps(py, fy));
+        __m128 w = fade_ps(_mm_sub_ps(pz, fz));
+        __m128 near_plane = lerp_ps(v, lerp_ps(u, _mm_load_ps(c[0]), _mm_load_ps(c[1])), lerp_ps(u, _mm_load_ps(c[2]), _mm_load_ps(c[3])));
+        __m128 far_plane = lerp_ps(v, lerp_ps(u, _mm_load_ps(c[4]), _mm_load_ps(c[5])), lerp_ps(u, _mm_load_ps(c[6]), _mm_load_ps(c[7])));
+        _mm_storeu_ps(out + i, lerp_ps(w, near_plane, far_plane));
+    }
+#endif
+    for (; i < count; i++) out[i] = value_noise(x[i], y[i], z[i]);
+}
+
+std::unique_ptr<NoiseSource> make_noise_source(Noise_Backend backend) {
+    switch (backend) {
+        case SIMPLEX_NOISE: return std::unique_ptr<NoiseSource>(new SimplexNoiseSource());
+        case VALUE_NOISE:   return std::unique_ptr<NoiseSource>(new ValueNoiseSource());
+        case PERLIN_NOISE:
+        default:            return std::unique_ptr<NoiseSource>(new PerlinNoiseSource());
+    }
+}
+
+// Catmull-Rom reproduces quadratics, so for |f'''| <= M on a lattice of spacing
+// h its error is at most 3/64 M h^3 (the Peano kernel bound), and it scales
+// errors already in its taps by at most 1.25, its largest sum of |weights|.
+// Rows are filtered first, so the column pass carries the row error too.
+static const float CUBIC_ERROR = 3.0f / 64.0f;
+static const float CUBIC_GAIN = 1.25f;
+
+static void catmull_rom_weights(float t, float w[4]) {
+    float t2 = t * t;
+    float t3 = t2 * t;
+    w[0] = 0.5f * (-t3 + 2.0f * t2 - t);
+    w[1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+    w[2] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+    w[3] = 0.5f * (t3 - t2);
+}
+
+// Lattice step in grid samples along an axis sampled at `frequency`; 1 keeps
+// the axis exact.
+static float lattice_step(float spacing, float frequency) {
+    if (spacing <= 0.0f || frequency <= 0.0f) return 1.0f;
+    return std::max(1.0f, spacing / frequency);
+}
+
+// Lattice samples along an axis: one before and two after the covered range,
+// so every grid sample has the four taps the cubic filter needs.
+static int lattice_size(int samples, float step) {
+    return (int)((samples - 1) / step) + 4;
+}
+
+float multires_spacing(const NoiseSource& source, float tolerance) {
+    if (tolerance <= 0.0f) return 0.0f;
+    return std::cbrt(tolerance / (CUBIC_ERROR * (CUBIC_GAIN + 1.0f) * source.third_derivative_bound()));
+}
+
+long long multires_samples(int width, int height, float frequency_x, float frequency_y, float spacing) {
+    float step_x = lattice_step(spacing, frequency_x);
+    float step_y = lattice_step(spacing, frequency_y);
+    long long grid = (long long)width * height;
+    if (step_x == 1.0f && step_y == 1.0f) return grid;
+    return std::min(grid, (long long)lattice_size(width, step_x) * lattice_size(height, step_y));
+}
+
+// Error bound of one unit-amplitude octave at `spacing`; 0 when it is sampled
+// exactly.
+static float lattice_error(const NoiseSource& source, int width, int height, float frequency_x, float frequency_y, float spacing) {
+    if (multires_samples(width, height, frequency_x, frequency_y, spacing) == (long long)width * height) return 0.0f;
+    float step_x = lattice_step(spacing, frequency_x);
+    float step_y = lattice_step(spacing, frequency_y);
+    float h_x = step_x > 1.0f ? step_x * frequency_x : 0.0f;
+    float h_y = step_y > 1.0f ? step_y * frequency_y : 0.0f;
+    return CUBIC_ERROR * source.third_derivative_bound() * (CUBIC_GAIN * h_x * h_x * h_x + h_y * h_y * h_y);
+}
+
+// Spending the budget on octaves i <= k so that sum a_i C s_i^3 = tolerance,
+// the sample count sum f_i^2 / s_i^2 is smallest for s_i proportional to
+// (f_i^2 / a_i)^(1/5): quieter octaves get coarser lattices. High octaves gain
+// least from a lattice, so only the k lowest are candidates, and the k that
+// evaluates the fewest samples wins.
+std::vector<float> multires_octave_spacings(const NoiseSource& source, int width, int height, float scale, int octaves, float persistence, float tolerance) {
+    std::vector<float> best(std::max(octaves, 0), 0.0f);
+    if (tolerance <= 0.0f) return best;
+    double error_per_spacing = CUBIC_ERROR * (CUBIC_GAIN + 1.0f) * source.third_derivative_bound();
+    long long best_samples = (long long)width * height * octaves;
+
+    std::vector<float> spacing(best.size());
+    std::vector<double> shape(best.size());
+    double budget = 0.0;
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    for (int k = 0; k < octaves && amplitude > 0.0f; k++) {
+        shape[k] = std::pow((double)(scale * frequency / width) * (scale * frequency / height) / amplitude, 0.2);
+        budget += amplitude * error_per_spacing * shape[k] * shape[k] * shape[k];
+        double lambda = std::cbrt(tolerance / budget);
+
+        long long samples = (long long)width * height * (octaves - k - 1);
+        float f = 1.0f;
+        for (int i = 0; i <= k; i++) {
+            spacing[i] = (float)(lambda * shape[i]);
+            samples += multires_samples(width, height, scale * f / width, scale * f / height, spacing[i]);
+            f *= 2.0f;
+        }
+        if (samples < best_samples) {
+            best_samples = samples;
+            std::copy(spacing.begin(), spacing.begin() + k + 1, best.begin());
+        }
+        frequency *= 2.0f;
+        amplitude *= persistence;
+    }
+    return best;
+}
+
+float multires_error_bound(const NoiseSource& source, int width, int height, float scale, int octaves, float persistence, float tolerance) {
+    std::vector<float> spacing = multires_octave_spacings(source, width, height, scale, octaves, persistence, tolerance);
+    float error = 0.0f;
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    for (int i = 0; i < octaves; i++) {
+        error += amplitude * lattice_error(source, width, height, scale * frequency / width, scale * frequency / height, spacing[i]);
+        frequency *= 2.0f;
+        amplitude *= persistence;
+    }
+    return error;
+}
+
+static void sample_rows(const NoiseSource& source, int width, int height, int row_begin, int row_end, float frequency_x, float frequency_y, float spacing, float* out) {
+    if (multires_samples(width, height, frequency_x, frequency_y, spacing) == (long long)width * height) {
+        std::vector<float> xs(width);
+        std::vector<float> ys(width);
+        for (int x = 0; x < width; x++) xs[x] = x * frequency_x;
+        for (int y = row_begin; y < row_end; y++) {
+            std::fill(ys.begin(), ys.end(), y * frequency_y);
+            source.sample_batch(&xs[0], &ys[0], &out[(y - row_begin) * width], width);
+        }
+        return;
+    }
+
+    // Lattice sample c sits at grid position (c - 1) * step, which need not
+    // be whole. Only the lattice rows under [row_begin, row_end) are
+    // evaluated; their positions do not depend on the range, so bands join
+    // up exactly.
+    float step_x = lattice_step(spacing, frequency_x);
+    float step_y = lattice_step(spacing, frequency_y);
+    int coarse_w = lattice_size(width, step_x);
+    int coarse_begin = (int)(row_begin / step_y);
+    int coarse_end = std::min((int)((row_end - 1) / step_y) + 4, lattice_size(height, step_y));
+    int coarse_h = coarse_end - coarse_begin;
+    std::vector<float> coarse(coarse_w * coarse_h);
+    std::vector<float> xs(coarse_w);
+    std::vector<float> ys(coarse_w);
+    for (int cx = 0; cx < coarse_w; cx++) xs[cx] = (cx - 1) * step_x * frequency_x;
+    for (int cy = 0; cy < coarse_h; cy++) {
+        std::fill(ys.begin(), ys.end(), (coarse_begin + cy - 1) * step_y * frequency_y);
+        source.sample_batch(&xs[0], &ys[0], &coarse[cy * coarse_w], coarse_w);
+    }
+
+    std::vector<float> weights_x(width * 4);
+    std::vector<int> taps_x(width);
+    for (int x = 0; x < width; x++) {
+        float t = x / step_x;
+        taps_x[x] = (int)t;
+        catmull_rom_weights(t - taps_x[x], &weights_x[x * 4]);
+    }
+
+    // Separable upsample: rows first, then columns.
+    std::vector<float> rows(coarse_h * width);
+    for (int cy = 0; cy < coarse_h; cy++) {
+        const float* src = &coarse[cy * coarse_w];
+        for (int x = 0; x < width; x++) {
+            const float* w = &weights_x[x * 4];
+            const float* s = src + taps_x[x];
+            rows[cy * width + x] = w[0] * s[0] + w[1] * s[1] + w[2] * s[2] + w[3] * s[3];
+        }
+    }
+
+    for (int y = row_begin; y < row_end; y++) {
+        float t = y / step_y;
+        int tap = (int)t;
+        float w[4];
+        catmull_rom_weights(t - tap, w);
+        const float* r0 = &rows[(tap - coarse_begin) * width];
+        const float* r1 = r0 + width;
+        const float* r2 = r1 + width;
+        const float* r3 = r2 + width;
+        float* dst = &out[(y - row_begin) * width];
+        for (int x = 0; x < width; x++) {
+            dst[x] = w[0] * r0[x] + w[1] * r1[x] + w[2] * r2[x] + w[3] * r3[x];
+        }
+    }
+}
+
+void generate_noise_rows(const NoiseSource& source, int width, int height, int row_begin, int row_end, float frequency_x, float frequency_y, float tolerance, float* out) {
+    sample_rows(source, width, height, row_begin, row_end, frequency_x, frequency_y, multires_spacing(source, tolerance), out);
+}
+
+std::vector<float> generate_noise_grid(const NoiseSource& source, int width, int height, float frequency_x, float frequency_y, float tolerance) {
+    std::vector<float> grid(width * height);
+    generate_noise_rows(source, width, height, 0, height, frequency_x, frequency_y, tolerance, &grid[0]);
+    return grid;
+}
+
+void generate_fbm_rows(const NoiseSource& source, int width, int height, int row_begin, int row_end, float scale, int octaves, float persistence, float tolerance, float* out, float& min_val, float& max_val) {
+    int count = (row_end - row_begin) * width;
+    std::vector<float> octave(count);
+    std::vector<float> spacing = multires_octave_spacings(source, width, height, scale, octaves, persistence, tolerance);
+
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    for (int i = 0; i < octaves; i++) {
+        sample_rows(source, width, height, row_begin, row_end, scale * frequency / width, scale * frequency / height, spacing[i], &octave[0]);
+        for (int j = 0; j < count; j++) {
+            float v = octave[j];
+            out[j] += v * amplitude;
+            min_val = std::min(min_val, v);
+            max_val = std::max(max_val, v);
+        }
+        frequency *= 2.0f;
+        amplitude *= persistence;
+    }
+}
+
+std::vector<float> generate_fbm_noise(const NoiseSource& source, int width, int height, float scale, int octaves, float persistence, float tolerance) {
+    std::vector<float> noise(width * height);
+    float min_val = std::numeric_limits<float>::max();
+    float max_val = std::numeric_limits<float>::lowest();
+    generate_fbm_rows(source, width, height, 0, height, scale, octaves, persistence, tolerance, &noise[0], min_val, max_val);
+
+    for (unsigned int i = 0; i < noise.size(); i++) {
+        noise[i] = (noise[i] - min_val) / (max_val - min_val);
+    }
+
+    return noise;
+}
@@ -0,0 +1,81 @@
+#include "perf_report.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+static double sorted_percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t rank = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+void Perf_Report::add_sample(const std::string& stage, double ms) {
+    for (unsigned int i = 0; i < stages.size(); i++) {
+        if (stages[i].name == stage) {
+            stages[i].samples.push_back(ms);
+            return;
+        }
+    }
+    Stage s;
+    s.name = stage;
+    s.samples.push_back(ms);
+    stages.push_back(s);
+}
+
+void Perf_Report::add_setup(const std::string& stage, double ms) {
+    Value v = {stage, ms};
+    setup.push_back(v);
+}
+
+void Perf_Report::set_value(const std::string& name, double value) {
+    for (unsigned int i = 0; i < values.size(); i++) {
+        if (values[i].name == name) {
+            values[i].value = value;
+            return;
+        }
+    }
+    Value v = {name, value};
+    values.push_back(v);
+}
+
+double Perf_Report::percentile(const std::string& stage, double p) const {
+    for (unsigned int i = 0; i < stages.size(); i++) {
+        if (stages[i].name == stage) {
+            std::vector<double> sorted = stages[i].samples;
+            std::sort(sorted.begin(), sorted.end());
+            return sorted_percentile(sorted, p);
+        }
+    }
+    return 0.0;
+}
+
+bool Perf_Report::write_json(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        fprintf(stderr, "ERROR: Could not open report file %s for writing\n", path.c_str());
+        return false;
+    }
+
+    fprintf(file, "{\n  \"stages\": {");
+    for (unsigned int i = 0; i < stages.size(); i++) {
+        std::vector<double> sorted = stages[i].samples;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (unsigned int j = 0; j < sorted.size(); j++) sum += sorted[j];
+        fprintf(file, "%s\n    \"%s\": {\"count\": %u, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p90_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f}",
+                i ? "," : "", stages[i].name.c_str(), (unsigned int)sorted.size(), sorted.empty() ? 0.0 : sum / sorted.size(),
+                sorted_percentile(sorted, 50), sorted_percentile(sorted, 90), sorted_percentile(sorted, 95),
+                sorted_percentile(sorted, 99), sorted.empty() ? 0.0 : sorted.back());
+    }
+    fprintf(file, "\n  },\n  \"setup_ms\": {");
+    for (unsigned int i = 0; i < setup.size(); i++) {
+        fprintf(file, "%s\n    \"%s\": %.4f", i ? "," : "", setup[i].name.c_str(), setup[i].value);
+    }
+    fprintf(file, "\n  },\n  \"values\": {");
+    for (unsigned int i = 0; i < values.size(); i++) {
+        fprintf(file, "%s\n    \"%s\": %.6g", i ? "," : "", values[i].name.c_str(), values[i].value);
+    }
+    fprintf(file, "\n  }\n}\n");
+    fclose(file);
+    return true;
+}
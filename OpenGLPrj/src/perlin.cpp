@@ -1,10 +1,29 @@
 #include "perlin.hpp"
+#include "noise.hpp"
+#include "fbm.hpp"
 
 #include <cmath>
 #include <vector>
 #include <algorithm>
 #include <random>
 
+const int perlin_perm[256] = {151, 160, 137,  91,  90,  15, 131,  13, 201,  95,  96,  53, 194, 233,   7, 225,
+    140,  36, 103,  30,  69, 142,   8,  99,  37, 240,  21,  10,  23, 190,   6, 148,
+    247, 120, 234,  75,   0,  26, 197,  62,  94, 252, 219, 203, 117,  35,  11,  32,
+    57,  177,  33,  88, 237, 149,  56,  87, 174,  20, 125, 136, 171, 168,  68, 175,
+    74,  165,  71, 134, 139,  48,  27, 166,  77, 146, 158, 231,  83, 111, 229, 122,
+    60,  211, 133, 230, 220, 105,  92,  41,  55,  46, 245,  40, 244, 102, 143,  54,
+    65,   25,  63, 161,   1, 216,  80,  73, 209,  76, 132, 187, 208,  89,  18, 169,
+    200, 196, 135, 130, 116, 188, 159,  86, 164, 100, 109, 198, 173, 186,   3,  64,
+    52,  217, 226, 250, 124, 123,   5, 202,  38, 147, 118, 126, 255,  82,  85, 212,
+    207, 206,  59, 227,  47,  16,  58,  17, 182, 189,  28,  42, 223, 183, 170, 213,
+    119, 248, 152,   2,  44, 154, 163,  70, 221, 153, 101, 155, 167,  43, 172,   9,
+    129,  22,  39, 253,  19,  98, 108, 110,  79, 113, 224, 232, 178, 185, 112, 104,
+    218, 246,  97, 228, 251,  34, 242, 193, 238, 210, 144,  12, 191, 179, 162, 241,
+    81,   51, 145, 235, 249,  14, 239, 107,  49, 192, 214,  31, 181, 199, 106, 157,
+    184,  84, 204, 176, 115, 121,  50,  45, 127,   4, 150, 254, 138, 236, 205,  93,
+    222, 114,  67,  29,  24,  72, 243, 141, 128, 195,  78,  66, 215,  61, 156, 180};
+
 float fade(float t) {
     return t * t * t * (t * (t * 6 - 15) + 10);
 }
@@ -20,43 +39,37 @@ float grad(int hash, float x, float y) {
     return (h & 1 ? -1 : 1) * (u + v);
 }
 
+float grad(int hash, float x, float y, float z) {
+    int h = hash & 15;
+    float u = h < 8 ? x : y;
+    float v = h < 4 ? y : h == 12 || h == 14 ? x : z;
+    return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+
+// Every table index wraps at 256. The original hash clamped perm[X] + Y to 0
+// once it reached 255 and read perm[256] at X = 255, which was out of bounds
+// and made the field jump along those lattice lines, which the multires
+// Catmull-Rom reconstruction cannot follow. The SIMD batches and
+// compute_noise.glsl use the same wrap. It changes the heights in about two
+// thirds of the lattice cells, so fields saved before it do not match.
 float perlin_noise(float x, float y) {
-    int X = (int)floor(x) & 255;
-    int Y = (int)floor(y) & 255;
+    int fx = fast_floor(x);
+    int fy = fast_floor(y);
+    int X = fx & 255;
+    int Y = fy & 255;
     
-    x -= std::floor(x);
-    y -= std::floor(y);
+    x -= fx;
+    y -= fy;
     
     float u = fade(x);
     float v = fade(y);
     
-    int perm[] = {151, 160, 137,  91,  90,  15, 131,  13, 201,  95,  96,  53, 194, 233,   7, 225,
-        140,  36, 103,  30,  69, 142,   8,  99,  37, 240,  21,  10,  23, 190,   6, 148,
-        247, 120, 234,  75,   0,  26, 197,  62,  94, 252, 219, 203, 117,  35,  11,  32,
-        57,  177,  33,  88, 237, 149,  56,  87, 174,  20, 125, 136, 171, 168,  68, 175,
-        74,  165,  71, 134, 139,  48,  27, 166,  77, 146, 158, 231,  83, 111, 229, 122,
-        60,  211, 133, 230, 220, 105,  92,  41,  55,  46, 245,  40, 244, 102, 143,  54,
-        65,   25,  63, 161,   1, 216,  80,  73, 209,  76, 132, 187, 208,  89,  18, 169,
-        200, 196, 135, 130, 116, 188, 159,  86, 164, 100, 109, 198, 173, 186,   3,  64,
-        52,  217, 226, 250, 124, 123,   5, 202,  38, 147, 118, 126, 255,  82,  85, 212,
-        207, 206,  59, 227,  47,  16,  58,  17, 182, 189,  28,  42, 223, 183, 170, 213,
-        119, 248, 152,   2,  44, 154, 163,  70, 221, 153, 101, 155, 167,  43, 172,   9,
-        129,  22,  39, 253,  19,  98, 108, 110,  79, 113, 224, 232, 178, 185, 112, 104,
-        218, 246,  97, 228, 251,  34, 242, 193, 238, 210, 144,  12, 191, 179, 162, 241,
-        81,   51, 145, 235, 249,  14, 239, 107,  49, 192, 214,  31, 181, 199, 106, 157,
-        184,  84, 204, 176, 115, 121,  50,  45, 127,   4, 150, 254, 138, 236, 205,  93,
-        222, 114,  67,  29,  24,  72, 243, 141, 128, 195,  78,  66, 215,  61, 156, 180};
-    
-    
-    
-    int a = perm[X] + Y;
-    if (a >= 255 || a < 0) a = 0;
-    int aa = perm[a];
-    int ab = perm[a + 1];
-    int b = perm[X + 1] + Y;
-    if (b >= 255 || b < 0) b = 0;
-    int ba = perm[b];
-    int bb = perm[b + 1];
+    int a = perlin_perm[X] + Y;
+    int b = perlin_perm[(X + 1) & 255] + Y;
+    int aa = perlin_perm[a & 255];
+    int ab = perlin_perm[(a + 1) & 255];
+    int ba = perlin_perm[b & 255];
+    int bb = perlin_perm[(b + 1) & 255];
     
     float gradAA = grad(aa, x, y);
     float gradAB = grad(ab, x, y - 1);
@@ -69,24 +82,56 @@ float perlin_noise(float x, float y) {
     return lerp(v, lerpX1, lerpX2);
 }
 
-float generate_perlin_noise_at(int x, int z, float scale, int octaves, float persistence) {
-    float total = 0.0f;
-    float max_val = 0.0f;
+float perlin_noise(float x, float y, float z) {
+    int fx = fast_floor(x);
+    int fy = fast_floor(y);
+    int fz = fast_floor(z);
+    int X = fx & 255;
+    int Y = fy & 255;
+    int Z = fz & 255;
+    
+    x -= fx;
+    y -= fy;
+    z -= fz;
     
-    for (int i = 0; i < octaves; i++) {
-        float frequency = std::pow(2.0f, i);
-        float amplitude = std::pow(persistence, i);
-        
-        float nx = x / scale * frequency;
-        float nz = z / scale * frequency;
-        
-        float v = perlin_noise(nx, nz);
-        total += v * amplitude;
-        max_val += amplitude;
-    }
+    float u = fade(x);
+    float v = fade(y);
+    float w = fade(z);
+    
+    int a = perlin_perm[X] + Y;
+    int aa = perlin_perm[a & 255] + Z;
+    int ab = perlin_perm[(a + 1) & 255] + Z;
+    int b = perlin_perm[(X + 1) & 255] + Y;
+    int ba = perlin_perm[b & 255] + Z;
+    int bb = perlin_perm[(b + 1) & 255] + Z;
+    
+    float x1 = lerp(u, grad(perlin_perm[aa & 255], x, y, z), grad(perlin_perm[ba & 255], x - 1, y, z));
+    float x2 = lerp(u, grad(perlin_perm[ab & 255], x, y - 1, z), grad(perlin_perm[bb & 255], x - 1, y - 1, z));
+    float x3 = lerp(u, grad(perlin_perm[(aa + 1) & 255], x, y, z - 1), grad(perlin_perm[(ba + 1) & 255], x - 1, y, z - 1));
+    float x4 = lerp(u, grad(perlin_perm[(ab + 1) & 255], x, y - 1, z - 1), grad(perlin_perm[(bb + 1) & 255], x - 1, y - 1, z - 1));
     
-    total = (total / max_val + 1.0f) / 2.0f;
-    return total;
+    return lerp(w, lerp(v, x1, x2), lerp(v, x3, x4));
+}
+
+// Weights and kernel for the last (octaves, persistence) seen on this thread,
+// so per-sample callers do not rebuild them for every sample.
+struct Fbm_Cache {
+    int octaves;
+    float persistence;
+    Fbm_Weights weights;
+    Fbm_Function kernel;
+};
+
+float generate_perlin_noise_at(int x, int z, float scale, int octaves, float persistence) {
+    static thread_local Fbm_Cache cache = {0, 0.0f, Fbm_Weights(), nullptr};
+    if (!cache.kernel || cache.octaves != octaves || cache.persistence != persistence) {
+        cache.octaves = octaves;
+        cache.persistence = persistence;
+        cache.weights = make_fbm_weights(octaves, persistence);
+        cache.kernel = select_fbm(PERLIN_NOISE, cache.weights);
+    }
+    float total = cache.kernel(x / scale, z / scale, cache.weights);
+    return (total + 1.0f) / 2.0f;
 }
 
 std::vector<float> generate_perlin_noise(int width, int height, float scale) {
@@ -119,11 +164,12 @@ std::vector<float> generate_perlin_noise(int width, int height, float scale, int
     
     for (int i = 0; i < octaves; i++) {
         float amplitude = std::pow(persistence, i);
+        float frequency = std::ldexp(1.0f, i);
         
         for (int y = 0; y < height; y++) {
             for (int x = 0; x < width; x++) {
-                float nx = x / (float)width * scale * std::pow(2, i);
-                float ny = y / (float)height * scale * std::pow(2, i);
+                float nx = x / (float)width * scale * frequency;
+                float ny = y / (float)height * scale * frequency;
                 float v = perlin_noise(nx, ny);
                 noise[y * width + x] += v * amplitude;
                 min_val = std::min(min_val, v);
@@ -199,4 +245,9 @@ void apply_gaussian_blur(std::vector<float>& noise, int width, int height, int k
     }
     
     noise = blurred_noise;
-}
\ No newline at end of file
+}
+
+std::vector<float> generate_perlin_noise_multires(int width, int height, float scale, int octaves, float persistence, float tolerance) {
+    PerlinNoiseSource perlin;
+    return generate_fbm_noise(perlin, width, height, scale, octaves, persistence, tolerance);
+}
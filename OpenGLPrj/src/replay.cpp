@@ -0,0 +1,100 @@
+#include "replay.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+// Every tick line holds ten whitespace-separated fields, so it takes at least
+// this many bytes; bounds the tick count a file header can claim.
+static const long MIN_TICK_BYTES = 20;
+
+Camera_State capture_camera_state(const Camera& camera) {
+    Camera_State state;
+    state.position = camera.position;
+    state.yaw = camera.yaw;
+    state.pitch = camera.pitch;
+    state.zoom = camera.zoom;
+    return state;
+}
+
+void restore_camera_state(Camera& camera, const Camera_State& state) {
+    camera.position = state.position;
+    camera.zoom = state.zoom;
+    camera.set_orientation(state.yaw, state.pitch);
+}
+
+float camera_state_drift(const Camera_State& a, const Camera_State& b) {
+    float drift = 0.0f;
+    for (int i = 0; i < 3; i++) drift = std::max(drift, std::fabs(a.position[i] - b.position[i]));
+    drift = std::max(drift, std::fabs(a.yaw - b.yaw));
+    drift = std::max(drift, std::fabs(a.pitch - b.pitch));
+    drift = std::max(drift, std::fabs(a.zoom - b.zoom));
+    return drift;
+}
+
+// Floats are written as C99 hex literals so a replay round-trips bit-exactly.
+static void write_state(FILE* file, const Camera_State& state) {
+    fprintf(file, "%a %a %a %a %a %a", state.position.x, state.position.y, state.position.z, state.yaw, state.pitch, state.zoom);
+}
+
+static bool read_state(FILE* file, Camera_State& state) {
+    return fscanf(file, "%a %a %a %a %a %a", &state.position.x, &state.position.y, &state.position.z, &state.yaw, &state.pitch, &state.zoom) == 6;
+}
+
+bool save_replay(const std::string& path, const Replay& replay) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        gl_log_err("log.log", "Could not open replay file %s for writing\n", path.c_str());
+        return false;
+    }
+
+    fprintf(file, "replay 1 %a %u\n", replay.timestep, (unsigned int)replay.ticks.size());
+    write_state(file, replay.start);
+    fprintf(file, "\n");
+    for (unsigned int i = 0; i < replay.ticks.size(); i++) {
+        const Replay_Tick& tick = replay.ticks[i];
+        fprintf(file, "%u %a %a %a ", tick.input.keys, tick.input.mouse_dx, tick.input.mouse_dy, tick.input.scroll);
+        write_state(file, tick.camera);
+        fprintf(file, "\n");
+    }
+    fclose(file);
+    return true;
+}
+
+bool load_replay(const std::string& path, Replay& replay) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file) {
+        gl_log_err("log.log", "Could not open replay file %s\n", path.c_str());
+        return false;
+    }
+
+    int version = 0;
+    unsigned int count = 0;
+    if (fscanf(file, "replay %d %a %u", &version, &replay.timestep, &count) != 3 || version != 1 || !read_state(file, replay.start)) {
+        gl_log_err("log.log", "%s is not a version 1 replay file\n", path.c_str());
+        fclose(file);
+        return false;
+    }
+
+    long header_end = ftell(file);
+    fseek(file, 0, SEEK_END);
+    long remaining = ftell(file) - header_end;
+    fseek(file, header_end, SEEK_SET);
+    if (header_end < 0 || remaining < 0 || (long long)count * MIN_TICK_BYTES > remaining) {
+        gl_log_err("log.log", "Replay file %s claims %u ticks but holds only %ld bytes of them\n", path.c_str(), count, remaining);
+        fclose(file);
+        return false;
+    }
+
+    replay.ticks.resize(count);
+    for (unsigned int i = 0; i < count; i++) {
+        Replay_Tick& tick = replay.ticks[i];
+        if (fscanf(file, "%u %a %a %a", &tick.input.keys, &tick.input.mouse_dx, &tick.input.mouse_dy, &tick.input.scroll) != 4 || !read_state(file, tick.camera)) {
+            gl_log_err("log.log", "Replay file %s is truncated at tick %u\n", path.c_str(), i);
+            fclose(file);
+            return false;
+        }
+    }
+    fclose(file);
+    return true;
+}
@@ -8,53 +8,87 @@
 #include <fstream>
 #include <sstream>
 
-Shader::Shader(const char* vertex_path, const char* fragment_path) {
-    std::string vertex_code;
-    std::string fragment_code;
-    std::ifstream vertex_file(vertex_path);
-    std::ifstream fragment_file(fragment_path);
-
-    if (!vertex_file.is_open() || !fragment_file.is_open()) {
-        gl_log_err("log.log", "ERROR: Could not open shader files %s and/or %s\n", vertex_path, fragment_path);
-        return;
+static bool read_shader_file(const char* path, std::string& code) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        gl_log_err("log.log", "ERROR: Could not open shader file %s\n", path);
+        return false;
     }
+    std::stringstream stream;
+    stream << file.rdbuf();
+    code = stream.str();
+    return true;
+}
 
-    std::stringstream vertex_stream;
-    std::stringstream fragment_stream;
+unsigned int Shader::compile_stage(unsigned int type, const std::string& code, const char* label) {
+    const char* source = code.c_str();
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    check_compile_errors(shader, label);
+    return shader;
+}
 
-    vertex_stream << vertex_file.rdbuf();
-    fragment_stream << fragment_file.rdbuf();
-    vertex_file.close();
-    fragment_file.close();
-    vertex_code = vertex_stream.str();
-    fragment_code = fragment_stream.str();
+Shader::Shader(const char* vertex_path, const char* fragment_path)
+: id(0) {
+    std::string vertex_code;
+    std::string fragment_code;
+    if (!read_shader_file(vertex_path, vertex_code) || !read_shader_file(fragment_path, fragment_code)) return;
 
-    const char* vertex_source = vertex_code.c_str();
-    const char* fragment_source = fragment_code.c_str();
+    unsigned int vertex = compile_stage(GL_VERTEX_SHADER, vertex_code, "VERTEX");
+    unsigned int fragment = compile_stage(GL_FRAGMENT_SHADER, fragment_code, "FRAGMENT");
+
+    id = glCreateProgram();
+    glAttachShader(id, vertex);
+    glAttachShader(id, fragment);
+    glLinkProgram(id);
+    check_compile_errors(id, "PROGRAM");
 
-    unsigned int vertex;
-    unsigned int fragment;
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+}
 
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vertex_source, NULL);
-    glCompileShader(vertex);
-    check_compile_errors(vertex, "VERTEX");
+Shader::Shader(const char* vertex_path, const char* tess_control_path, const char* tess_evaluation_path, const char* fragment_path)
+: id(0) {
+    std::string vertex_code;
+    std::string tess_control_code;
+    std::string tess_evaluation_code;
+    std::string fragment_code;
+    if (!read_shader_file(vertex_path, vertex_code) || !read_shader_file(tess_control_path, tess_control_code)
+        || !read_shader_file(tess_evaluation_path, tess_evaluation_code) || !read_shader_file(fragment_path, fragment_code)) return;
 
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fragment_source, NULL);
-    glCompileShader(fragment);
-    check_compile_errors(fragment, "FRAGMENT");
+    unsigned int vertex = compile_stage(GL_VERTEX_SHADER, vertex_code, "VERTEX");
+    unsigned int tess_control = compile_stage(GL_TESS_CONTROL_SHADER, tess_control_code, "TESS_CONTROL");
+    unsigned int tess_evaluation = compile_stage(GL_TESS_EVALUATION_SHADER, tess_evaluation_code, "TESS_EVALUATION");
+    unsigned int fragment = compile_stage(GL_FRAGMENT_SHADER, fragment_code, "FRAGMENT");
 
     id = glCreateProgram();
     glAttachShader(id, vertex);
+    glAttachShader(id, tess_control);
+    glAttachShader(id, tess_evaluation);
     glAttachShader(id, fragment);
     glLinkProgram(id);
     check_compile_errors(id, "PROGRAM");
 
     glDeleteShader(vertex);
+    glDeleteShader(tess_control);
+    glDeleteShader(tess_evaluation);
     glDeleteShader(fragment);
 }
 
+Shader::Shader(const char* compute_path)
+: id(0) {
+    std::string compute_code;
+    if (!read_shader_file(compute_path, compute_code)) return;
+
+    unsigned int compute = compile_stage(GL_COMPUTE_SHADER, compute_code, "COMPUTE");
+    id = glCreateProgram();
+    glAttachShader(id, compute);
+    glLinkProgram(id);
+    check_compile_errors(id, "PROGRAM");
+    glDeleteShader(compute);
+}
+
 Shader::~Shader() {
     glDeleteProgram(id);
 }
@@ -63,6 +97,12 @@ void Shader::use() {
     glUseProgram(id);
 }
 
+bool Shader::valid() const {
+    int linked = 0;
+    if (id) glGetProgramiv(id, GL_LINK_STATUS, &linked);
+    return linked != 0;
+}
+
 void Shader::set_bool(const std::string& name, bool value) const {
     glUniform1i(glGetUniformLocation(id, name.c_str()), (int)value);
 }
@@ -0,0 +1,133 @@
+#include "simulation.hpp"
+#include "timer.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+// The simulation skips ahead rather than replaying a backlog longer than this,
+// matching the cap the single-threaded loop put on its accumulator.
+static const double MAX_CATCH_UP_MS = 250.0;
+
+static bool has_activity(const Input_Frame& input) {
+    return input.keys != 0 || input.mouse_dx != 0.0f || input.mouse_dy != 0.0f || input.scroll != 0.0f;
+}
+
+static void merge_input(Input_Frame& into, const Input_Frame& input) {
+    into.keys = input.keys;
+    into.mouse_dx += input.mouse_dx;
+    into.mouse_dy += input.mouse_dy;
+    into.scroll += input.scroll;
+}
+
+Simulation::Simulation(const Camera& camera, float timestep, Replay* recording, Terrain* cull_terrain)
+: camera(camera), timestep(timestep), recording(recording), cull_terrain(cull_terrain), running(false), next_sequence(1) {
+    Input_Frame idle = {0, 0.0f, 0.0f, 0.0f};
+    carry.input = idle;
+    carry.sequence = 0;
+    carry.time_ms = 0.0;
+
+    Camera_Snapshot& snapshot = snapshots.write_slot();
+    snapshot.previous = snapshot.current = capture_camera_state(camera);
+    snapshot.tick_ms = now_ms();
+    snapshot.tick = 0;
+    snapshot.input_sequence = 0;
+    snapshot.input_ms = 0.0;
+    snapshots.publish();
+
+    if (recording) {
+        recording->timestep = timestep;
+        recording->start = snapshot.current;
+    }
+}
+
+Simulation::~Simulation() {
+    stop();
+}
+
+void Simulation::start() {
+    if (running) return;
+    running = true;
+    thread = std::thread(&Simulation::loop, this);
+}
+
+void Simulation::stop() {
+    running = false;
+    if (thread.joinable()) thread.join();
+}
+
+void Simulation::push_input(const Input_Frame& input) {
+    merge_input(carry.input, input);
+    if (has_activity(input)) {
+        carry.sequence = next_sequence++;
+        carry.time_ms = now_ms();
+    }
+    if (!inputs.push(carry)) return;
+    carry.input.mouse_dx = carry.input.mouse_dy = carry.input.scroll = 0.0f;
+    carry.sequence = 0;
+}
+
+const Camera_Snapshot& Simulation::latest_snapshot() {
+    return snapshots.read();
+}
+
+void Simulation::loop() {
+    const double step_ms = timestep * 1000.0;
+    Input_Frame pending = {0, 0.0f, 0.0f, 0.0f};
+    unsigned int input_sequence = 0;
+    double input_ms = 0.0;
+    unsigned int tick = 0;
+    double next_tick = now_ms() + step_ms;
+
+    while (running) {
+        Timed_Input input;
+        while (inputs.pop(input)) {
+            merge_input(pending, input.input);
+            if (input.sequence != 0) {
+                input_sequence = input.sequence;
+                input_ms = input.time_ms;
+            }
+        }
+
+        Camera_State previous = capture_camera_state(camera);
+        apply_input(camera, pending, timestep);
+        if (recording) {
+            Replay_Tick replay_tick = {pending, capture_camera_state(camera)};
+            recording->ticks.push_back(replay_tick);
+        }
+        pending.mouse_dx = pending.mouse_dy = pending.scroll = 0.0f;
+
+        Camera_Snapshot& snapshot = snapshots.write_slot();
+        snapshot.previous = previous;
+        snapshot.current = capture_camera_state(camera);
+        snapshot.tick_ms = now_ms();
+        snapshot.tick = ++tick;
+        snapshot.input_sequence = input_sequence;
+        snapshot.input_ms = input_ms;
+        // The slot's vectors keep their capacity, so this stops allocating
+        // once every slot has held a large enough cull.
+        if (cull_terrain) {
+            const glm::vec3& eye = snapshot.current.position;
+            cull_terrain->cull_hidden_patches(eye.x, eye.y, eye.z, snapshot.draw_ranges);
+        }
+        snapshots.publish();
+
+        double now = now_ms();
+        if (now - next_tick > MAX_CATCH_UP_MS) next_tick = now;
+        if (next_tick > now) std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(next_tick - now));
+        next_tick += step_ms;
+    }
+}
+
+Camera_State interpolate_camera_state(const Camera_State& a, const Camera_State& b, float t) {
+    Camera_State state;
+    state.position = a.position + (b.position - a.position) * t;
+    state.yaw = a.yaw + (b.yaw - a.yaw) * t;
+    state.pitch = a.pitch + (b.pitch - a.pitch) * t;
+    state.zoom = a.zoom + (b.zoom - a.zoom) * t;
+    return state;
+}
+
+float snapshot_alpha(const Camera_Snapshot& snapshot, double time_ms, float timestep) {
+    float alpha = (float)((time_ms - snapshot.tick_ms) / (timestep * 1000.0));
+    return std::max(0.0f, std::min(alpha, 1.0f));
+}
@@ -1,54 +1,134 @@
 #include "terrain.hpp"
 #include "perlin.hpp"
+#include "timer.hpp"
+#include "gpu_generator.hpp"
+#include "log.hpp"
 
-#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
-Terrain::Terrain(int width, int height, float scale, float displacement, float noise_scale, int noise_octaves, float noise_persistence)
-: width(width), height(height), scale(scale), displacement(displacement), noise_scale(noise_scale), noise_octaves(noise_octaves), noise_persistence(noise_persistence) {
-    generate_noise();
-    generate_texture();
-    generate_vertices();
-    generate_indices();
+Terrain::Terrain(int width, int height, float scale, float displacement, float noise_scale, int noise_octaves, float noise_persistence, bool noise_multires, Noise_Backend noise_backend, Job_System* jobs, Terrain_Render_Mode render_mode, Gpu_Generator* gpu_generator)
+: width(width), height(height), scale(scale), displacement(displacement), noise_scale(noise_scale), noise_octaves(noise_octaves), noise_persistence(noise_persistence), noise_multires(noise_multires), render_mode(render_mode), noise_source(make_noise_source(noise_backend)), index_count(0), patch_vertex_count(0), patches_x((width + TERRAIN_PATCH_QUADS - 2) / TERRAIN_PATCH_QUADS), patches_z((height + TERRAIN_PATCH_QUADS - 2) / TERRAIN_PATCH_QUADS), gpu_generator(gpu_generator), vao(0), vbo(0), ebo(0), texture_id(0), release_gl(nullptr), noise_memory(MEMORY_NOISE), mesh_memory(MEMORY_MESH), buffer_memory(MEMORY_GPU_BUFFERS), texture_memory(MEMORY_TEXTURES) {
+    if (render_mode == TERRAIN_MESH) index_count = (width - 1) * (height - 1) * 6;
+    if (gpu_generator && (noise_multires || noise_backend != PERLIN_NOISE || !gpu_generator->supported())) {
+        gl_log("log.log", "WARNING: GPU generation needs exact Perlin noise and OpenGL 4.3, generating on the CPU\n");
+        this->gpu_generator = nullptr;
+    }
+    if (this->gpu_generator) return;
+
+    noise.assign(width * height, 0.0f);
+    noise_memory.set(noise.capacity() * sizeof(float));
+    if (render_mode == TERRAIN_MESH) {
+        vertices.resize(width * height * 8);
+        indices.resize((width - 1) * (height - 1) * 6);
+        mesh_memory.set(vertices.capacity() * sizeof(float) + indices.capacity() * sizeof(unsigned int));
+    }
+
+    if (jobs) build_parallel(*jobs);
+    else build_serial();
+
+    double start = now_ms();
+    build_patch_bounds(noise.data());
+    record_stage("patch_bounds", start);
 }
 
 Terrain::~Terrain() {
-    glDeleteVertexArrays(1, &vao);
-    glDeleteBuffers(1, &vbo);
-    glDeleteBuffers(1, &ebo);
-    glDeleteTextures(1, &texture_id);
+    if (release_gl) release_gl(*this);
 }
 
-void Terrain::generate_noise() {
-    noise = generate_perlin_noise(width, height, noise_scale, noise_octaves, noise_persistence);
-    apply_biome_blending();
+void Terrain::build_serial() {
+    double start = now_ms();
+    generate_noise(0, height);
+    record_stage("noise", start);
+
+    start = now_ms();
+    std::vector<float> biome(width * height), field(width * height);
+    Memory_Tracker scratch_memory(MEMORY_NOISE);
+    scratch_memory.set((biome.capacity() + field.capacity()) * sizeof(float));
+    generate_biome(0, height, &biome[0], &field[0]);
+    apply_biome_blending(0, height, &biome[0], &field[0]);
+    record_stage("biome_blending", start);
+    if (render_mode != TERRAIN_MESH) return;
+
+    start = now_ms();
+    generate_vertices(0, height);
+    record_stage("vertices", start);
+
+    start = now_ms();
+    generate_indices(0, height - 1);
+    record_stage("indices", start);
 }
 
-void Terrain::apply_biome_blending() {
-    for (int z = 0; z < height; z++) {
-        for (int x = 0; x < width; x++) {
-            int idx = z * width + x;
-            float hill = noise[idx];
-            float biome = (perlin_noise(x * 0.01f, z * 0.01f) + 1.0f) / 2.0f;
-            float field = (perlin_noise(x * noise_scale * 0.2f, z * noise_scale * 0.2f) + 1.0f) / 2.0f;
-            field = powf(field, 10.0f);
-            float blended = (1.0f - biome) * field + biome * hill;
-            noise[idx] = blended;
-        }
+// Every band runs noise -> biome blending -> vertices -> indices on its own:
+// hills are normalised by a fixed bound rather than the field's min/max, so no
+// band waits for another. The result is identical to build_serial.
+void Terrain::build_parallel(Job_System& jobs) {
+    double start = now_ms();
+    int band_rows = std::max(1, std::min(32, height / (4 * jobs.get_thread_count())));
+
+    std::vector<float> biome(width * height), field(width * height);
+    Memory_Tracker scratch_memory(MEMORY_NOISE);
+    scratch_memory.set((biome.capacity() + field.capacity()) * sizeof(float));
+
+    jobs.parallel_for(0, height, band_rows, [&](int row_begin, int row_end) {
+        generate_noise(row_begin, row_end);
+        generate_biome(row_begin, row_end, &biome[row_begin * width], &field[row_begin * width]);
+        apply_biome_blending(row_begin, row_end, &biome[row_begin * width], &field[row_begin * width]);
+        if (render_mode != TERRAIN_MESH) return;
+        generate_vertices(row_begin, row_end);
+        generate_indices(row_begin, std::min(row_end, height - 1));
+    });
+    record_stage("pipeline", start);
+}
+
+void Terrain::generate_noise(int row_begin, int row_end) {
+    float tolerance = noise_multires ? MULTIRES_TOLERANCE : 0.0f;
+    float min_val = std::numeric_limits<float>::max();
+    float max_val = std::numeric_limits<float>::lowest();
+    generate_fbm_rows(*noise_source, width, height, row_begin, row_end, noise_scale, noise_octaves, noise_persistence, tolerance, &noise[row_begin * width], min_val, max_val);
+}
+
+void Terrain::generate_biome(int row_begin, int row_end, float* biome, float* field) {
+    // The 0.01 biome frequency is far below the grid rate, so in multires mode
+    // it is sampled on a coarse lattice; the field noise stays exact either way.
+    float tolerance = noise_multires ? MULTIRES_TOLERANCE : 0.0f;
+    generate_noise_rows(*noise_source, width, height, row_begin, row_end, 0.01f, 0.01f, tolerance, biome);
+    generate_noise_rows(*noise_source, width, height, row_begin, row_end, noise_scale * 0.2f, noise_scale * 0.2f, tolerance, field);
+}
+
+// Hills are mapped to [0, 1] by the octave amplitude sum, the bound baked
+// tiles and compute_noise.glsl use too, so a band needs no other band's data.
+void Terrain::apply_biome_blending(int row_begin, int row_end, const float* biome, const float* field) {
+    float max_val = 0.0f;
+    float amplitude = 1.0f;
+    for (int i = 0; i < noise_octaves; i++) {
+        max_val += amplitude;
+        amplitude *= noise_persistence;
+    }
+
+    float* heights = &noise[row_begin * width];
+    for (int i = 0; i < (row_end - row_begin) * width; i++) {
+        float hill = (heights[i] / max_val + 1.0f) / 2.0f;
+        float b = (biome[i] + 1.0f) / 2.0f;
+        float f = powf((field[i] + 1.0f) / 2.0f, 10.0f);
+        heights[i] = (1.0f - b) * f + b * hill;
     }
 }
 
-void Terrain::generate_vertices() {
+void Terrain::generate_vertices(int row_begin, int row_end) {
     float min_height = 0.0f;
     float max_height = scale * displacement;
     float threshold = max_height * 0.5f;
     
-    for (int z = 0; z < height; z++) {
+    for (int z = row_begin; z < row_end; z++) {
         for (int x = 0; x < width; x++) {
             float noise_height = noise[z * width + x] * scale * displacement * 2.0f;
+            float* vertex = &vertices[(z * width + x) * 8];
             
-            vertices.push_back(x * scale);
-            vertices.push_back(noise_height);
-            vertices.push_back(z * scale);
+            vertex[0] = x * scale;
+            vertex[1] = noise_height;
+            vertex[2] = z * scale;
             
             float t = (noise_height - min_height) / (max_height - min_height);
             if (t > 1.0f) t = 1.0f;
@@ -57,73 +137,141 @@ void Terrain::generate_vertices() {
             float g = (1.0f - t) * 0.9f + t * 0.5f;
             float b = (1.0f - t) * 0.2f + t * 0.5f;
             
-            vertices.push_back(r);
-            vertices.push_back(g);
-            vertices.push_back(b);
+            vertex[3] = r;
+            vertex[4] = g;
+            vertex[5] = b;
             
-            vertices.push_back((float)x / width);
-            vertices.push_back((float)z / height);
+            vertex[6] = (float)x / width;
+            vertex[7] = (float)z / height;
         }
     }
 }
 
-void Terrain::generate_indices() {
-    for (int z = 0; z < height - 1; z++) {
+int Terrain::patch_first_quad(int patch_x, int patch_z) const {
+    // Every earlier patch row is full height; earlier patches in this row are
+    // full width.
+    return patch_z * TERRAIN_PATCH_QUADS * (width - 1) + patch_x * TERRAIN_PATCH_QUADS * std::min(TERRAIN_PATCH_QUADS, height - 1 - patch_z * TERRAIN_PATCH_QUADS);
+}
+
+int Terrain::patch_quad_count(int patch_x, int patch_z) const {
+    return std::min(TERRAIN_PATCH_QUADS, width - 1 - patch_x * TERRAIN_PATCH_QUADS) * std::min(TERRAIN_PATCH_QUADS, height - 1 - patch_z * TERRAIN_PATCH_QUADS);
+}
+
+void Terrain::generate_indices(int row_begin, int row_end) {
+    for (int z = row_begin; z < row_end; z++) {
+        int patch_z = z / TERRAIN_PATCH_QUADS;
+        int local_z = z - patch_z * TERRAIN_PATCH_QUADS;
         for (int x = 0; x < width - 1; x++) {
             int top_left = z * width + x;
             int top_right = top_left + 1;
             int bottom_left = (z + 1) * width + x;
             int bottom_right = bottom_left + 1;
+            int patch_x = x / TERRAIN_PATCH_QUADS;
+            int patch_width = std::min(TERRAIN_PATCH_QUADS, width - 1 - patch_x * TERRAIN_PATCH_QUADS);
+            int quad_index = patch_first_quad(patch_x, patch_z) + local_z * patch_width + x - patch_x * TERRAIN_PATCH_QUADS;
+            unsigned int* quad = &indices[quad_index * 6];
             
-            indices.push_back(top_left);
-            indices.push_back(bottom_left);
-            indices.push_back(top_right);
+            quad[0] = top_left;
+            quad[1] = bottom_left;
+            quad[2] = top_right;
             
-            indices.push_back(top_right);
-            indices.push_back(bottom_left);
-            indices.push_back(bottom_right);
+            quad[3] = top_right;
+            quad[4] = bottom_left;
+            quad[5] = bottom_right;
         }
     }
 }
 
-void Terrain::generate_texture() {
-    glGenTextures(1, &texture_id);
-    glBindTexture(GL_TEXTURE_2D, texture_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_FLOAT, noise.data());
-    glGenerateMipmap(GL_TEXTURE_2D);
+// Bounds of every cell_quads x cell_quads block of quads, row by row, in the
+// same height mapping as generate_vertices and the tessellation shaders.
+static std::vector<Patch_Bounds> cell_bounds(const float* heights, int width, int height, float scale, float height_scale, int cell_quads) {
+    std::vector<Patch_Bounds> bounds;
+    for (int z0 = 0; z0 < height - 1; z0 += cell_quads) {
+        for (int x0 = 0; x0 < width - 1; x0 += cell_quads) {
+            int x1 = std::min(x0 + cell_quads, width - 1);
+            int z1 = std::min(z0 + cell_quads, height - 1);
+            float lo = std::numeric_limits<float>::max();
+            float hi = std::numeric_limits<float>::lowest();
+            for (int z = z0; z <= z1; z++) {
+                for (int x = x0; x <= x1; x++) {
+                    lo = std::min(lo, heights[z * width + x]);
+                    hi = std::max(hi, heights[z * width + x]);
+                }
+            }
+            Patch_Bounds cell = {x0 * scale, z0 * scale, x1 * scale, z1 * scale, lo * height_scale, hi * height_scale};
+            bounds.push_back(cell);
+        }
+    }
+    return bounds;
 }
 
-void Terrain::upload_to_gpu() {
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
-    glGenBuffers(1, &ebo);
-    
-    glBindVertexArray(vao);
-    
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-    
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-    
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    
-    glBindVertexArray(0);
+void Terrain::build_patch_bounds(const float* heights) {
+    float height_scale = scale * displacement * 2.0f;
+    culler.set_patches(cell_bounds(heights, width, height, scale, height_scale, TERRAIN_PATCH_QUADS),
+                       cell_bounds(heights, width, height, scale, height_scale, TERRAIN_OCCLUDER_QUADS));
+}
+
+float Terrain::cull_hidden_patches(float eye_x, float eye_y, float eye_z, Terrain_Draw_Ranges& ranges) {
+    culler.cull(eye_x, eye_y, eye_z, patch_visible);
+    ranges.culled = true;
+    ranges.first.clear();
+    ranges.count.clear();
+    ranges.offsets.clear();
+
+    // Patches are stored in the same order in both modes, so runs of visible
+    // patches merge into single draws.
+    int hidden_quads = 0;
+    int run_start = -1;
+    for (int patch = 0; patch <= patches_x * patches_z; patch++) {
+        bool visible = patch < patches_x * patches_z && patch_visible[patch];
+        if (patch < patches_x * patches_z && !visible) hidden_quads += patch_quad_count(patch % patches_x, patch / patches_x);
+        if (visible && run_start < 0) run_start = patch;
+        if (visible || run_start < 0) continue;
+
+        if (render_mode == TERRAIN_TESSELLATED) {
+            ranges.first.push_back(run_start * 4);
+            ranges.count.push_back((patch - run_start) * 4);
+        } else {
+            int first = patch_first_quad(run_start % patches_x, run_start / patches_x);
+            int end = patch < patches_x * patches_z ? patch_first_quad(patch % patches_x, patch / patches_x) : index_count / 6;
+            ranges.count.push_back((end - first) * 6);
+            ranges.offsets.push_back((const void*)(first * 6 * sizeof(unsigned int)));
+        }
+        run_start = -1;
+    }
+    return (float)hidden_quads / ((width - 1) * (height - 1));
+}
+
+Terrain_Render_Mode Terrain::get_render_mode() const {
+    return render_mode;
+}
+
+size_t Terrain::get_geometry_bytes() const {
+    if (render_mode == TERRAIN_TESSELLATED) return patch_vertex_count * 2 * sizeof(float);
+    return (size_t)width * height * 8 * sizeof(float) + (size_t)index_count * sizeof(unsigned int);
+}
+
+bool Terrain::generated_on_gpu() const {
+    return gpu_generator != nullptr;
+}
+
+const std::vector<float>& Terrain::get_noise() const {
+    return noise;
+}
+
+const std::vector<float>& Terrain::get_vertices() const {
+    return vertices;
+}
+
+const std::vector<unsigned int>& Terrain::get_indices() const {
+    return indices;
+}
+
+const std::vector<Stage_Timing>& Terrain::get_stage_timings() const {
+    return stage_timings;
 }
 
-void Terrain::render() const {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture_id);
-    glBindVertexArray(vao);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+void Terrain::record_stage(const char* name, double start_ms) {
+    Stage_Timing timing = {name, now_ms() - start_ms};
+    stage_timings.push_back(timing);
 }
\ No newline at end of file
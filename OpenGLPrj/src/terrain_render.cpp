@@ -0,0 +1,173 @@
+#include "terrain.hpp"
+#include "timer.hpp"
+#include "shader.hpp"
+#include "gpu_generator.hpp"
+
+#include <glad/glad.h>
+#include <algorithm>
+
+// The GL half of Terrain: uploading, GPU generation, drawing and read-back.
+// terrain.cpp builds the heightfield and mesh without touching GL.
+
+void Terrain::delete_gl_objects(Terrain& terrain) {
+    if (!terrain.vao) return;
+    glDeleteVertexArrays(1, &terrain.vao);
+    glDeleteBuffers(1, &terrain.vbo);
+    glDeleteBuffers(1, &terrain.ebo);
+    glDeleteTextures(1, &terrain.texture_id);
+}
+
+void Terrain::generate_texture(const float* data) {
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, data);
+    // Both paths build the full mip chain.
+    texture_memory.set(estimate_texture_bytes(width, height, sizeof(float), true));
+    if (data) glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+void Terrain::upload_to_gpu() {
+    release_gl = delete_gl_objects;
+    if (gpu_generator) {
+        generate_on_gpu();
+        return;
+    }
+    double start = now_ms();
+    generate_texture(noise.data());
+    record_stage("texture", start);
+
+    start = now_ms();
+    if (render_mode == TERRAIN_TESSELLATED) {
+        upload_patches();
+        record_stage("upload", start);
+        return;
+    }
+    create_mesh_buffers(vertices.data(), indices.data());
+    record_stage("upload", start);
+}
+
+// The compute passes write the texture and buffers that render() draws; only
+// allocation and the mipmap chain are done here.
+void Terrain::generate_on_gpu() {
+    double start = now_ms();
+    generate_texture(nullptr);
+    if (render_mode == TERRAIN_MESH) create_mesh_buffers(nullptr, nullptr);
+    record_stage("gpu_alloc", start);
+
+    Gpu_Terrain_Params params = {width, height, scale, displacement, noise_scale, noise_octaves, noise_persistence};
+    gpu_generator->generate(params, texture_id, render_mode == TERRAIN_MESH ? vbo : 0, render_mode == TERRAIN_MESH ? ebo : 0, stage_timings);
+
+    start = now_ms();
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    if (render_mode == TERRAIN_TESSELLATED) upload_patches();
+    glFinish();
+    record_stage("upload", start);
+
+    // The culler needs the heights on the CPU; one float per sample.
+    start = now_ms();
+    std::vector<float> heights(width * height);
+    Memory_Tracker heights_memory(MEMORY_NOISE);
+    heights_memory.set(heights.capacity() * sizeof(float));
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, heights.data());
+    build_patch_bounds(heights.data());
+    record_stage("patch_bounds", start);
+}
+
+// Vertex/index data may be null to only allocate storage.
+void Terrain::create_mesh_buffers(const float* vertex_data, const unsigned int* index_data) {
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ebo);
+    
+    glBindVertexArray(vao);
+    
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, (size_t)width * height * 8 * sizeof(float), vertex_data, GL_STATIC_DRAW);
+    
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (size_t)index_count * sizeof(unsigned int), index_data, GL_STATIC_DRAW);
+    buffer_memory.set((size_t)width * height * 8 * sizeof(float) + (size_t)index_count * sizeof(unsigned int));
+    
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    
+    glBindVertexArray(0);
+}
+
+// One patch per TERRAIN_PATCH_QUADS x TERRAIN_PATCH_QUADS block of samples;
+// corners are heightfield sample coordinates and the shaders do the rest.
+void Terrain::upload_patches() {
+    std::vector<float> corners;
+    for (int z0 = 0; z0 < height - 1; z0 += TERRAIN_PATCH_QUADS) {
+        for (int x0 = 0; x0 < width - 1; x0 += TERRAIN_PATCH_QUADS) {
+            float x1 = (float)std::min(x0 + TERRAIN_PATCH_QUADS, width - 1);
+            float z1 = (float)std::min(z0 + TERRAIN_PATCH_QUADS, height - 1);
+            float patch[8] = {(float)x0, (float)z0, x1, (float)z0, x1, z1, (float)x0, z1};
+            corners.insert(corners.end(), patch, patch + 8);
+        }
+    }
+    patch_vertex_count = (int)corners.size() / 2;
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, corners.size() * sizeof(float), corners.data(), GL_STATIC_DRAW);
+    buffer_memory.set(corners.size() * sizeof(float));
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+}
+
+void Terrain::render(const Terrain_Draw_Ranges* ranges) const {
+    bool culled = ranges && ranges->culled;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glBindVertexArray(vao);
+    if (render_mode == TERRAIN_TESSELLATED) {
+        glPatchParameteri(GL_PATCH_VERTICES, 4);
+        if (culled) glMultiDrawArrays(GL_PATCHES, ranges->first.data(), ranges->count.data(), (int)ranges->count.size());
+        else glDrawArrays(GL_PATCHES, 0, patch_vertex_count);
+    } else {
+        if (culled) glMultiDrawElements(GL_TRIANGLES, ranges->count.data(), GL_UNSIGNED_INT, ranges->offsets.data(), (int)ranges->count.size());
+        else glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0);
+    }
+    glBindVertexArray(0);
+}
+
+void Terrain::set_tessellation_uniforms(const Shader& shader) const {
+    shader.set_vec2("gridSize", (float)width, (float)height);
+    shader.set_float("gridSpacing", scale);
+    // Same height mapping and colour range as generate_vertices.
+    shader.set_float("heightScale", scale * displacement * 2.0f);
+    shader.set_float("maxHeight", scale * displacement);
+}
+
+void Terrain::read_back(std::vector<float>& heights, std::vector<float>& vertex_data, std::vector<unsigned int>& index_data) const {
+    heights.resize(width * height);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, heights.data());
+
+    vertex_data.clear();
+    index_data.clear();
+    if (render_mode != TERRAIN_MESH) return;
+    vertex_data.resize(width * height * 8);
+    index_data.resize(index_count);
+    // The element binding belongs to the VAO, so read through the copy target.
+    glBindBuffer(GL_COPY_READ_BUFFER, vbo);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, vertex_data.size() * sizeof(float), vertex_data.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, ebo);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, index_data.size() * sizeof(unsigned int), index_data.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
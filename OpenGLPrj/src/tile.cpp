@@ -0,0 +1,131 @@
+#include "tile.hpp"
+#include "heightfield_codec.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static const char TILE_MAGIC[4] = {'H', 'T', 'I', 'L'};
+static const unsigned int TILE_VERSION = 2;
+
+enum Tile_Encoding {
+    TILE_RAW = 0,
+    TILE_COMPRESSED = 1
+};
+
+void generate_tile(const NoiseSource& source, const Tile_Params& params, int tile_x, int tile_z, Tile& tile) {
+    int samples = params.tile_size + 1;
+    tile.tile_x = tile_x;
+    tile.tile_z = tile_z;
+    tile.samples = samples;
+    tile.heights.assign(samples * samples, 0.0f);
+
+    int origin_x = tile_x * params.tile_size;
+    int origin_z = tile_z * params.tile_size;
+
+    float max_val = 0.0f;
+    float amplitude = 1.0f;
+    for (int i = 0; i < params.octaves; i++) {
+        max_val += amplitude;
+        amplitude *= params.persistence;
+    }
+
+    std::vector<float> xs(samples), zs(samples), row(samples), biome(samples), field(samples);
+    for (int z = 0; z < samples; z++) {
+        float* heights = &tile.heights[z * samples];
+
+        float frequency = 1.0f;
+        amplitude = 1.0f;
+        for (int i = 0; i < params.octaves; i++) {
+            for (int x = 0; x < samples; x++) {
+                xs[x] = (origin_x + x) / params.scale * frequency;
+                zs[x] = (origin_z + z) / params.scale * frequency;
+            }
+            source.sample_batch(&xs[0], &zs[0], &row[0], samples);
+            for (int x = 0; x < samples; x++) heights[x] += row[x] * amplitude;
+            frequency *= 2.0f;
+            amplitude *= params.persistence;
+        }
+
+        // The biome/field blend of Terrain::apply_biome_blending, but in world
+        // coordinates: the field is sampled at a fixed 0.2 per world unit
+        // rather than Terrain's noise_scale * 0.2 per grid sample. Baked tiles
+        // therefore match each other, not the interactive terrain.
+        for (int x = 0; x < samples; x++) {
+            xs[x] = (origin_x + x) * 0.01f;
+            zs[x] = (origin_z + z) * 0.01f;
+        }
+        source.sample_batch(&xs[0], &zs[0], &biome[0], samples);
+        for (int x = 0; x < samples; x++) {
+            xs[x] = (origin_x + x) * 0.2f;
+            zs[x] = (origin_z + z) * 0.2f;
+        }
+        source.sample_batch(&xs[0], &zs[0], &field[0], samples);
+
+        for (int x = 0; x < samples; x++) {
+            float hill = (heights[x] / max_val + 1.0f) / 2.0f;
+            float b = (biome[x] + 1.0f) / 2.0f;
+            float f = powf((field[x] + 1.0f) / 2.0f, 10.0f);
+            heights[x] = (1.0f - b) * f + b * hill;
+        }
+    }
+}
+
+bool write_tile(const std::string& path, const Tile& tile, float tolerance) {
+    std::vector<unsigned char> encoded;
+    if (tolerance > 0.0f) {
+        encoded = encode_heightfield(tile.heights.data(), tile.samples, tile.samples, tolerance);
+        if (encoded.empty()) return false;
+    }
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "ERROR: Could not open tile file %s for writing\n", path.c_str());
+        return false;
+    }
+
+    int header[5] = {tile.tile_x, tile.tile_z, tile.samples, tolerance > 0.0f ? TILE_COMPRESSED : TILE_RAW, (int)encoded.size()};
+    bool ok = fwrite(TILE_MAGIC, 1, 4, file) == 4
+           && fwrite(&TILE_VERSION, sizeof(TILE_VERSION), 1, file) == 1
+           && fwrite(header, sizeof(int), 5, file) == 5;
+    if (ok && encoded.empty()) ok = fwrite(tile.heights.data(), sizeof(float), tile.heights.size(), file) == tile.heights.size();
+    else if (ok) ok = fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) fprintf(stderr, "ERROR: Failed writing tile file %s\n", path.c_str());
+    return ok;
+}
+
+bool read_tile(const std::string& path, int tile_size, Tile& tile) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    char magic[4];
+    unsigned int version = 0;
+    // Version 1 tiles have no encoding fields and are always raw.
+    int header[5] = {0, 0, 0, TILE_RAW, 0};
+    bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, TILE_MAGIC, 4) == 0
+           && fread(&version, sizeof(version), 1, file) == 1 && (version == 1 || version == TILE_VERSION)
+           && fread(header, sizeof(int), version == 1 ? 3 : 5, file) == (version == 1 ? 3u : 5u) && header[2] == tile_size + 1;
+    if (ok) {
+        tile.tile_x = header[0];
+        tile.tile_z = header[1];
+        tile.samples = header[2];
+        tile.heights.resize(tile.samples * tile.samples);
+        if (header[3] == TILE_RAW) {
+            ok = fread(tile.heights.data(), sizeof(float), tile.heights.size(), file) == tile.heights.size();
+        } else {
+            std::vector<unsigned char> encoded(header[4] > 0 ? header[4] : 0);
+            ok = header[3] == TILE_COMPRESSED && !encoded.empty()
+              && fread(encoded.data(), 1, encoded.size(), file) == encoded.size();
+            if (ok) {
+                Heightfield_Decoder decoder(encoded.data(), encoded.size());
+                ok = decoder.valid() && decoder.get_width() == tile.samples && decoder.get_height() == tile.samples
+                  && decoder.decode(tile.heights);
+            }
+        }
+    }
+    fclose(file);
+    if (!ok) fprintf(stderr, "ERROR: %s is not a valid tile file\n", path.c_str());
+    return ok;
+}
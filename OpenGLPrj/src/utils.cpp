@@ -1,12 +1,28 @@
 #include "utils.hpp"
 
 #include <glad/glad.h>
-#include <fstream>
-#include <ctime>
-#include <cstdarg>
-#include <sstream>
+#include <cstdlib>
 
-bool init_opengl(GLFWwindow*& window, int window_width, int window_height, const char* title) {
+#ifdef OPENGLPRJ_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay egl_display = EGL_NO_DISPLAY;
+static EGLContext egl_context = EGL_NO_CONTEXT;
+#endif
+
+static unsigned int headless_fbo = 0;
+static unsigned int headless_color = 0;
+static unsigned int headless_depth = 0;
+
+static Input_Frame pending_input = {0, 0.0f, 0.0f, 0.0f};
+
+// Context versions to request, newest first: compute-shader generation needs
+// 4.3, everything else 4.0, so a driver without 4.3 still gets a context.
+static const int GL_CONTEXT_VERSIONS[][2] = {{4, 3}, {4, 0}};
+static const int GL_CONTEXT_VERSION_COUNT = sizeof(GL_CONTEXT_VERSIONS) / sizeof(GL_CONTEXT_VERSIONS[0]);
+
+bool init_opengl(GLFWwindow*& window, int window_width, int window_height, const char* title, bool visible) {
     if (!glfwInit()) {
         gl_log_err("log.log", "Failed to initialize GLFW");
         return false;
@@ -14,13 +30,20 @@ bool init_opengl(GLFWwindow*& window, int window_width, int window_height, const
     //gl_log("log.log", "OpenGL version: %s\n", glGetString(GL_VERSION));
     glfwSetErrorCallback(glfw_error_callback);
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_SAMPLES, 4);
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 
-    window = glfwCreateWindow(window_width, window_height, title, NULL, NULL);
+    window = NULL;
+    for (int i = 0; i < GL_CONTEXT_VERSION_COUNT && !window; i++) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, GL_CONTEXT_VERSIONS[i][0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, GL_CONTEXT_VERSIONS[i][1]);
+        window = glfwCreateWindow(window_width, window_height, title, NULL, NULL);
+        if (!window && i + 1 < GL_CONTEXT_VERSION_COUNT)
+            gl_log("log.log", "WARNING: No OpenGL %d.%d core context, trying %d.%d\n", GL_CONTEXT_VERSIONS[i][0], GL_CONTEXT_VERSIONS[i][1],
+                   GL_CONTEXT_VERSIONS[i + 1][0], GL_CONTEXT_VERSIONS[i + 1][1]);
+    }
     if (!window) {
         gl_log_err("log.log", "Failed to create GLFW window");
         glfwTerminate();
@@ -38,60 +61,124 @@ bool init_opengl(GLFWwindow*& window, int window_width, int window_height, const
     return true;
 }
 
-void configure_opengl(GLFWwindow* window, Camera& camera) {
-    glfwSetWindowUserPointer(window, &camera);
-    glfwSetCursorPosCallback(window, glfw_mouse_callback);
-    glfwSetScrollCallback(window, glfw_scroll_callback);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    glEnable(GL_DEPTH_TEST);
-}
+#ifdef OPENGLPRJ_EGL
+static bool init_egl_surfaceless() {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (get_platform_display)
+        egl_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (egl_display == EGL_NO_DISPLAY)
+        egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, NULL, NULL)) {
+        gl_log_err("log.log", "Failed to initialize EGL display\n");
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        gl_log_err("log.log", "EGL does not support desktop OpenGL\n");
+        return false;
+    }
 
-bool restart_gl_log(const std::string& log_file_path) {
-    std::ofstream log_file(log_file_path.c_str(), std::ios::out | std::ios::trunc);
-    if (!log_file.is_open()) {
-        fprintf(stderr, "ERROR: Could not open log file %s for writing\n", log_file_path.c_str());
+    // Surfaceless displays only offer pbuffer configs, and the default
+    // EGL_SURFACE_TYPE of EGL_WINDOW_BIT would match none of them.
+    const EGLint config_attribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config;
+    EGLint config_count = 0;
+    if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &config_count) || config_count == 0) {
+        gl_log_err("log.log", "No EGL config with OpenGL support\n");
+        return false;
+    }
+
+    for (int i = 0; i < GL_CONTEXT_VERSION_COUNT && egl_context == EGL_NO_CONTEXT; i++) {
+        const EGLint context_attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, GL_CONTEXT_VERSIONS[i][0],
+            EGL_CONTEXT_MINOR_VERSION, GL_CONTEXT_VERSIONS[i][1],
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, context_attribs);
+        if (egl_context == EGL_NO_CONTEXT && i + 1 < GL_CONTEXT_VERSION_COUNT)
+            gl_log("log.log", "WARNING: No OpenGL %d.%d core EGL context, trying %d.%d\n", GL_CONTEXT_VERSIONS[i][0], GL_CONTEXT_VERSIONS[i][1],
+                   GL_CONTEXT_VERSIONS[i + 1][0], GL_CONTEXT_VERSIONS[i + 1][1]);
+    }
+    if (egl_context == EGL_NO_CONTEXT || !eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_context)) {
+        gl_log_err("log.log", "Failed to create surfaceless EGL context\n");
+        return false;
+    }
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        gl_log_err("log.log", "Failed to initialize GLAD\n");
         return false;
     }
-    std::time_t now = std::time(nullptr);
-    std::string date = std::ctime(&now);
-    log_file << "GL_LOG_FILE log. Log started: " << date << std::endl;
-    log_file.close();
     return true;
 }
 
-bool gl_log(const std::string& log_file_path, const char* message, ...) {
-    std::ofstream log_file(log_file_path.c_str(), std::ios::out | std::ios::app);
-    if (!log_file.is_open()) {
-        fprintf(stderr, "ERROR: Could not open log file %s for writing\n", log_file_path.c_str());
+static void shutdown_egl() {
+    if (egl_display == EGL_NO_DISPLAY) return;
+    eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (egl_context != EGL_NO_CONTEXT) eglDestroyContext(egl_display, egl_context);
+    eglTerminate(egl_display);
+    egl_context = EGL_NO_CONTEXT;
+    egl_display = EGL_NO_DISPLAY;
+}
+#endif
+
+// Renders into an offscreen framebuffer. Prefers a surfaceless EGL context
+// (works on Mesa llvmpipe with no display server) and falls back to a hidden
+// GLFW window, in which case `window` is set and must be passed to shutdown.
+bool init_opengl_headless(GLFWwindow*& window, int width, int height) {
+    window = NULL;
+    bool has_context = false;
+#ifdef OPENGLPRJ_EGL
+    has_context = init_egl_surfaceless();
+    if (!has_context) shutdown_egl();
+#endif
+    if (!has_context && !init_opengl(window, width, height, "OpenGLPrj", false)) return false;
+
+    glGenFramebuffers(1, &headless_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, headless_fbo);
+    glGenRenderbuffers(1, &headless_color);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless_color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headless_color);
+    glGenRenderbuffers(1, &headless_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, headless_depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        gl_log_err("log.log", "Offscreen framebuffer is incomplete\n");
+        shutdown_opengl(window);
         return false;
     }
-    va_list args;
-    va_start(args, message);
-    char buffer[1024];
-    vsnprintf(buffer, sizeof(buffer), message, args);
-    va_end(args);
-    log_file << buffer << std::endl;
-    log_file.close();
+
+    glViewport(0, 0, width, height);
+    glEnable(GL_DEPTH_TEST);
     return true;
 }
 
-bool gl_log_err(const std::string& log_file_path, const char* message, ...) {
-    std::ofstream log_file(log_file_path.c_str(), std::ios::out | std::ios::app);
-    if (!log_file.is_open()) {
-        fprintf(stderr, "ERROR: Could not open log file %s for writing\n", log_file_path.c_str());
-        return false;
+void shutdown_opengl(GLFWwindow* window) {
+    if (headless_fbo) {
+        glDeleteFramebuffers(1, &headless_fbo);
+        glDeleteRenderbuffers(1, &headless_color);
+        glDeleteRenderbuffers(1, &headless_depth);
+        headless_fbo = headless_color = headless_depth = 0;
     }
-    va_list args;
-    va_start(args, message);
-    char buffer[1024];
-    vsnprintf(buffer, sizeof(buffer), message, args);
-    va_end(args);
-    log_file << "ERROR: " << buffer << std::endl;
-    va_start(args, message);
-    vfprintf(stderr, message, args);
-    va_end(args);
-    log_file.close();
+#ifdef OPENGLPRJ_EGL
+    shutdown_egl();
+#endif
+    if (window) glfwTerminate();
+}
+
+bool display_available() {
+#if defined(__linux__) || defined(__FreeBSD__)
+    return getenv("DISPLAY") != NULL || getenv("WAYLAND_DISPLAY") != NULL;
+#else
     return true;
+#endif
+}
+
+void configure_opengl(GLFWwindow* window) {
+    glfwSetCursorPosCallback(window, glfw_mouse_callback);
+    glfwSetScrollCallback(window, glfw_scroll_callback);
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    glEnable(GL_DEPTH_TEST);
 }
 
 void glfw_error_callback(int error, const char* description) {
@@ -106,10 +193,7 @@ void glfw_framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     gl_log("log.log", "Viewport: %i x %i\n", width, height);
 }
 
-void glfw_mouse_callback(GLFWwindow* window, double xpos, double ypos) {
-    Camera *camera = (Camera*)glfwGetWindowUserPointer(window);
-    if (!camera) return;
-
+void glfw_mouse_callback(GLFWwindow*, double xpos, double ypos) {
     static bool first_mouse = true;
     static float last_x = 0.0f;
     static float last_y = 0.0f;
@@ -129,48 +213,52 @@ void glfw_mouse_callback(GLFWwindow* window, double xpos, double ypos) {
     last_x = xpos_output;
     last_y = ypos_output;
 
-    camera->process_mouse_movement(xoffset, yoffset);
+    pending_input.mouse_dx += xoffset;
+    pending_input.mouse_dy += yoffset;
 }
 
-void glfw_scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
-    Camera *camera = (Camera*)glfwGetWindowUserPointer(window);
-    if (!camera) return;
-    camera->process_mouse_scroll((float)yoffset);
+void glfw_scroll_callback(GLFWwindow*, double, double yoffset) {
+    pending_input.scroll += (float)yoffset;
 }
 
-void process_input(GLFWwindow* window, Camera& camera, float delta_time) {
+Input_Frame poll_input(GLFWwindow* window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-        if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
-            camera.process_keyboard(Camera_Movement::FORWARD, true, delta_time);
-        camera.process_keyboard(Camera_Movement::FORWARD, false, delta_time);
-    }
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-        if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
-            camera.process_keyboard(Camera_Movement::BACKWARD, true, delta_time);
-        camera.process_keyboard(Camera_Movement::BACKWARD, false, delta_time);
-    }
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-        if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
-            camera.process_keyboard(Camera_Movement::LEFT, true, delta_time);
-        camera.process_keyboard(Camera_Movement::LEFT, false, delta_time);
-    }
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-        if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
-            camera.process_keyboard(Camera_Movement::RIGHT, true, delta_time);
-        camera.process_keyboard(Camera_Movement::RIGHT, false, delta_time);
-    }
+    Input_Frame input = pending_input;
+    input.keys = 0;
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) input.keys |= INPUT_FORWARD;
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) input.keys |= INPUT_BACKWARD;
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) input.keys |= INPUT_LEFT;
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) input.keys |= INPUT_RIGHT;
+    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) input.keys |= INPUT_UP;
+    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) input.keys |= INPUT_DOWN;
+    if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS) input.keys |= INPUT_SPRINT;
 
-    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
-        if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
-            camera.process_keyboard(Camera_Movement::UP, true, delta_time);
-        camera.process_keyboard(Camera_Movement::UP, false, delta_time);
-    }
-    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) {
-        if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
-            camera.process_keyboard(Camera_Movement::DOWN, true, delta_time);
-        camera.process_keyboard(Camera_Movement::DOWN, false, delta_time);
+    pending_input.mouse_dx = 0.0f;
+    pending_input.mouse_dy = 0.0f;
+    pending_input.scroll = 0.0f;
+    return input;
+}
+
+void apply_input(Camera& camera, const Input_Frame& input, float delta_time) {
+    static const Input_Key keys[] = {INPUT_FORWARD, INPUT_BACKWARD, INPUT_LEFT, INPUT_RIGHT, INPUT_UP, INPUT_DOWN};
+    static const Camera_Movement movements[] = {FORWARD, BACKWARD, LEFT, RIGHT, UP, DOWN};
+    bool is_sprint = (input.keys & INPUT_SPRINT) != 0;
+
+    for (int i = 0; i < 6; i++) {
+        if (!(input.keys & keys[i])) continue;
+        if (is_sprint)
+            camera.process_keyboard(movements[i], true, delta_time);
+        camera.process_keyboard(movements[i], false, delta_time);
     }
-}
\ No newline at end of file
+
+    if (input.mouse_dx != 0.0f || input.mouse_dy != 0.0f)
+        camera.process_mouse_movement(input.mouse_dx, input.mouse_dy);
+    if (input.scroll != 0.0f)
+        camera.process_mouse_scroll(input.scroll);
+}
+
+void process_input(GLFWwindow* window, Camera& camera, float delta_time) {
+    apply_input(camera, poll_input(window), delta_time);
+}
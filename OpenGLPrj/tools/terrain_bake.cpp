@@ -0,0 +1,466 @@
+// Bakes a tiled world into a shared output directory.
+//
+// Any number of worker processes, on this host (--workers N) or on other
+// hosts that mount the same directory, cooperate through files only:
+//   manifest.txt        world parameters; every worker checks it matches
+//   tile_X_Z.lock       claim, created with exclusive-create; holds owner+time
+//   tile_X_Z.bin        finished tile, published by renaming a private temp file
+//                       (compressed with the heightfield codec when --codec is given)
+// A tile whose .bin exists is never baked again, so re-running after a crash
+// resumes where it stopped. A worker rewrites the time in its lock every
+// 1/LOCK_REFRESHES_PER_TIMEOUT of --lock-timeout while it bakes, so only the
+// lock of a dead worker gets older than the timeout; such locks are treated as
+// abandoned and reclaimed. Tiles are pure functions of their world
+// coordinates, so the rare double bake after a reclaim race is harmless.
+
+#include "tile.hpp"
+#include "noise.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Lock refreshes per --lock-timeout; a live worker has to miss all of them
+// before its tile is reclaimed.
+static const int LOCK_REFRESHES_PER_TIMEOUT = 6;
+static const int DEFAULT_LOCK_TIMEOUT = 30;
+
+// World parameters given on the command line; only these are checked against
+// an existing manifest.
+enum Manifest_Field {
+    FIELD_TILES = 1 << 0,
+    FIELD_TILE_SIZE = 1 << 1,
+    FIELD_SCALE = 1 << 2,
+    FIELD_OCTAVES = 1 << 3,
+    FIELD_PERSISTENCE = 1 << 4,
+    FIELD_BACKEND = 1 << 5,
+    FIELD_TOLERANCE = 1 << 6
+};
+
+struct Bake_Config {
+    std::string out_dir;
+    int tiles_x;
+    int tiles_z;
+    Tile_Params params;
+    float tolerance;
+    int workers;
+    int worker_id;
+    int lock_timeout;
+    bool verify;
+};
+
+static const char* backend_name(Noise_Backend backend) {
+    return make_noise_source(backend)->name();
+}
+
+static bool parse_backend(const std::string& name, Noise_Backend& backend) {
+    if (name == "perlin") backend = PERLIN_NOISE;
+    else if (name == "simplex") backend = SIMPLEX_NOISE;
+    else if (name == "value") backend = VALUE_NOISE;
+    else return false;
+    return true;
+}
+
+static bool file_exists(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    fclose(file);
+    return true;
+}
+
+static std::string tile_path(const Bake_Config& config, int tile_x, int tile_z, const char* extension) {
+    char name[64];
+    snprintf(name, sizeof(name), "/tile_%d_%d.%s", tile_x, tile_z, extension);
+    return config.out_dir + name;
+}
+
+static std::string worker_name(int worker_id) {
+    char host[128] = "localhost";
+#ifdef _WIN32
+    const char* computer = getenv("COMPUTERNAME");
+    if (computer) snprintf(host, sizeof(host), "%s", computer);
+    int pid = _getpid();
+#else
+    gethostname(host, sizeof(host) - 1);
+    int pid = (int)getpid();
+#endif
+    char name[192];
+    snprintf(name, sizeof(name), "%s-%d-w%d", host, pid, worker_id);
+    return name;
+}
+
+// Publishes a fully written file under its final name in one step.
+static bool commit_file(const std::string& temp_path, const std::string& final_path) {
+    if (rename(temp_path.c_str(), final_path.c_str()) == 0) return true;
+    // Windows refuses to replace an existing file; someone else already won.
+    bool published = file_exists(final_path);
+    remove(temp_path.c_str());
+    return published;
+}
+
+static void write_manifest_fields(FILE* file, const Bake_Config& config) {
+    fprintf(file, "terrain_bake 1\n");
+    fprintf(file, "tiles %d %d\n", config.tiles_x, config.tiles_z);
+    fprintf(file, "tile_size %d\n", config.params.tile_size);
+    fprintf(file, "scale %a\n", config.params.scale);
+    fprintf(file, "octaves %d\n", config.params.octaves);
+    fprintf(file, "persistence %a\n", config.params.persistence);
+    fprintf(file, "backend %s\n", backend_name(config.params.backend));
+    fprintf(file, "tolerance %a\n", config.tolerance);
+}
+
+static bool read_manifest(const std::string& path, Bake_Config& config) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file) return false;
+    int version = 0;
+    char backend[32];
+    bool ok = fscanf(file, "terrain_bake %d tiles %d %d tile_size %d scale %a octaves %d persistence %a backend %31s tolerance %a",
+                     &version, &config.tiles_x, &config.tiles_z, &config.params.tile_size, &config.params.scale,
+                     &config.params.octaves, &config.params.persistence, backend, &config.tolerance) == 9
+           && version == 1 && parse_backend(backend, config.params.backend);
+    fclose(file);
+    return ok;
+}
+
+static bool manifest_matches(const Bake_Config& stored, const Bake_Config& config, unsigned int given) {
+    return (!(given & FIELD_TILES) || (stored.tiles_x == config.tiles_x && stored.tiles_z == config.tiles_z))
+        && (!(given & FIELD_TILE_SIZE) || stored.params.tile_size == config.params.tile_size)
+        && (!(given & FIELD_SCALE) || stored.params.scale == config.params.scale)
+        && (!(given & FIELD_OCTAVES) || stored.params.octaves == config.params.octaves)
+        && (!(given & FIELD_PERSISTENCE) || stored.params.persistence == config.params.persistence)
+        && (!(given & FIELD_BACKEND) || stored.params.backend == config.params.backend)
+        && (!(given & FIELD_TOLERANCE) || stored.tolerance == config.tolerance);
+}
+
+// Creates the manifest on first use; afterwards every worker must agree with
+// the parameters it was given and takes the rest from the manifest.
+static bool ensure_manifest(Bake_Config& config, unsigned int given) {
+    std::string path = config.out_dir + "/manifest.txt";
+    if (!file_exists(path)) {
+        if (!given) {
+            fprintf(stderr, "ERROR: %s does not exist; pass the world parameters to create it\n", path.c_str());
+            return false;
+        }
+        std::string temp_path = path + ".tmp." + worker_name(config.worker_id);
+        FILE* file = fopen(temp_path.c_str(), "w");
+        if (!file) {
+            fprintf(stderr, "ERROR: Could not write %s\n", temp_path.c_str());
+            return false;
+        }
+        write_manifest_fields(file, config);
+        bool written = !ferror(file);
+        if (fclose(file) != 0 || !written || !commit_file(temp_path, path)) {
+            remove(temp_path.c_str());
+            fprintf(stderr, "ERROR: Could not write %s\n", path.c_str());
+            return false;
+        }
+    }
+
+    Bake_Config stored = config;
+    if (!read_manifest(path, stored)) {
+        fprintf(stderr, "ERROR: %s is not a valid manifest\n", path.c_str());
+        return false;
+    }
+    if (!manifest_matches(stored, config, given)) {
+        fprintf(stderr, "ERROR: parameters do not match existing %s\n", path.c_str());
+        return false;
+    }
+    config.tiles_x = stored.tiles_x;
+    config.tiles_z = stored.tiles_z;
+    config.params = stored.params;
+    config.tolerance = stored.tolerance;
+    return true;
+}
+
+static bool write_claim(FILE* lock, const std::string& owner) {
+    fprintf(lock, "%s %lld\n", owner.c_str(), (long long)time(NULL));
+    return fclose(lock) == 0;
+}
+
+static bool try_claim(const std::string& lock_path, const std::string& owner) {
+    FILE* lock = fopen(lock_path.c_str(), "wx");
+    if (!lock) return false;
+    write_claim(lock, owner);
+    return true;
+}
+
+// Moves the claim time forward if `owner` still holds the lock. Readers see
+// the rewrite as an unparsable, and therefore live, lock while it happens.
+static bool refresh_lock(const std::string& lock_path, const std::string& owner) {
+    FILE* lock = fopen(lock_path.c_str(), "r");
+    if (!lock) return false;
+    char holder[192];
+    bool held = fscanf(lock, "%191s", holder) == 1 && owner == holder;
+    fclose(lock);
+    if (!held) return false;
+    lock = fopen(lock_path.c_str(), "w");
+    return lock && write_claim(lock, owner);
+}
+
+// Refreshes a claimed lock from a background thread for as long as it lives,
+// so a tile that takes longer than the timeout is not reclaimed from its
+// live owner.
+class Lock_Heartbeat {
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopped;
+    std::thread thread;
+
+    void run(std::string lock_path, std::string owner, int interval) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wake.wait_for(lock, std::chrono::seconds(interval), [this]() { return stopped; })) refresh_lock(lock_path, owner);
+    }
+
+public:
+    Lock_Heartbeat(const std::string& lock_path, const std::string& owner, int interval)
+    : stopped(false), thread(&Lock_Heartbeat::run, this, lock_path, owner, interval) {}
+
+    ~Lock_Heartbeat() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+};
+
+static bool lock_is_stale(const std::string& lock_path, int timeout) {
+    FILE* lock = fopen(lock_path.c_str(), "r");
+    if (!lock) return false;
+    char owner[192];
+    long long claimed_at = 0;
+    // A lock that cannot be parsed yet is still being written by its owner.
+    bool parsed = fscanf(lock, "%191s %lld", owner, &claimed_at) == 2;
+    fclose(lock);
+    return parsed && (long long)time(NULL) - claimed_at > timeout;
+}
+
+static bool break_stale_lock(const std::string& lock_path, const std::string& owner) {
+    std::string stale_path = lock_path + ".stale." + owner;
+    if (rename(lock_path.c_str(), stale_path.c_str()) != 0) return false;
+    remove(stale_path.c_str());
+    return true;
+}
+
+static int run_worker(const Bake_Config& config) {
+    std::string owner = worker_name(config.worker_id);
+    std::unique_ptr<NoiseSource> source = make_noise_source(config.params.backend);
+    int total = config.tiles_x * config.tiles_z;
+    int refresh_interval = std::max(1, config.lock_timeout / LOCK_REFRESHES_PER_TIMEOUT);
+    // Start workers at different offsets so they rarely contend for a claim.
+    int offset = (int)((long long)(config.worker_id < 0 ? 0 : config.worker_id) * total / config.workers) % total;
+    int baked = 0;
+
+    for (;;) {
+        int pending = 0;
+        for (int n = 0; n < total; n++) {
+            int index = (n + offset) % total;
+            int tile_x = index % config.tiles_x;
+            int tile_z = index / config.tiles_x;
+            std::string final_path = tile_path(config, tile_x, tile_z, "bin");
+            std::string lock_path = tile_path(config, tile_x, tile_z, "lock");
+            if (file_exists(final_path)) continue;
+
+            bool claimed = try_claim(lock_path, owner);
+            if (!claimed && lock_is_stale(lock_path, config.lock_timeout) && break_stale_lock(lock_path, owner)) {
+                fprintf(stderr, "%s: reclaiming abandoned tile %d %d\n", owner.c_str(), tile_x, tile_z);
+                claimed = try_claim(lock_path, owner);
+            }
+            if (!claimed) {
+                pending++;
+                continue;
+            }
+            // The previous owner may have published just before releasing the lock.
+            if (file_exists(final_path)) {
+                remove(lock_path.c_str());
+                continue;
+            }
+
+            std::string temp_path = final_path + ".tmp." + owner;
+            bool ok;
+            {
+                Lock_Heartbeat heartbeat(lock_path, owner, refresh_interval);
+                Tile tile;
+                generate_tile(*source, config.params, tile_x, tile_z, tile);
+                ok = write_tile(temp_path, tile, config.tolerance) && commit_file(temp_path, final_path);
+            }
+            remove(lock_path.c_str());
+            if (!ok) {
+                remove(temp_path.c_str());
+                fprintf(stderr, "ERROR: %s failed to publish tile %d %d\n", owner.c_str(), tile_x, tile_z);
+                return EXIT_FAILURE;
+            }
+            baked++;
+        }
+        if (pending == 0) break;
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    printf("%s: baked %d tiles\n", owner.c_str(), baked);
+    return EXIT_SUCCESS;
+}
+
+static int launch_workers(const Bake_Config& config, int argc, char** argv) {
+#ifndef _WIN32
+    (void)argc;
+    (void)argv;
+#endif
+    std::vector<int> children;
+    for (int i = 0; i < config.workers; i++) {
+#ifdef _WIN32
+        char worker_id[16];
+        snprintf(worker_id, sizeof(worker_id), "%d", i);
+        std::vector<const char*> args(argv, argv + argc);
+        args.push_back("--worker-id");
+        args.push_back(worker_id);
+        args.push_back(NULL);
+        intptr_t child = _spawnv(_P_NOWAIT, argv[0], &args[0]);
+        if (child == -1) {
+            fprintf(stderr, "ERROR: Could not start worker %d\n", i);
+            return EXIT_FAILURE;
+        }
+        children.push_back((int)child);
+#else
+        pid_t child = fork();
+        if (child < 0) {
+            fprintf(stderr, "ERROR: Could not start worker %d\n", i);
+            return EXIT_FAILURE;
+        }
+        if (child == 0) {
+            Bake_Config worker = config;
+            worker.worker_id = i;
+            int status = run_worker(worker);
+            fflush(stdout);
+            _exit(status);
+        }
+        children.push_back((int)child);
+#endif
+    }
+
+    int result = EXIT_SUCCESS;
+    for (unsigned int i = 0; i < children.size(); i++) {
+        int status = 0;
+#ifdef _WIN32
+        if (_cwait(&status, (intptr_t)children[i], 0) == -1 || status != 0) result = EXIT_FAILURE;
+#else
+        if (waitpid((pid_t)children[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) result = EXIT_FAILURE;
+#endif
+    }
+    return result;
+}
+
+// Checks that every shared border row/column is bit-identical between neighbours.
+static int verify_tiles(const Bake_Config& config) {
+    int missing = 0;
+    int seams = 0;
+    int mismatched = 0;
+    for (int tile_z = 0; tile_z < config.tiles_z; tile_z++) {
+        for (int tile_x = 0; tile_x < config.tiles_x; tile_x++) {
+            Tile tile;
+            if (!read_tile(tile_path(config, tile_x, tile_z, "bin"), config.params.tile_size, tile)) {
+                missing++;
+                continue;
+            }
+            int n = tile.samples;
+            Tile right, below;
+            if (tile_x + 1 < config.tiles_x && read_tile(tile_path(config, tile_x + 1, tile_z, "bin"), config.params.tile_size, right)) {
+                seams++;
+                for (int i = 0; i < n; i++) {
+                    if (memcmp(&tile.heights[i * n + n - 1], &right.heights[i * n], sizeof(float)) != 0) {
+                        mismatched++;
+                        break;
+                    }
+                }
+            }
+            if (tile_z + 1 < config.tiles_z && read_tile(tile_path(config, tile_x, tile_z + 1, "bin"), config.params.tile_size, below)) {
+                seams++;
+                if (memcmp(&tile.heights[(n - 1) * n], &below.heights[0], n * sizeof(float)) != 0) mismatched++;
+            }
+        }
+    }
+    printf("verified %d seams: %d mismatched, %d tiles missing\n", seams, mismatched, missing);
+    return mismatched == 0 && missing == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+            "usage: %s --out DIR [--tiles X Z] [--tile-size N] [--scale S] [--octaves N]\n"
+            "          [--persistence P] [--backend perlin|simplex|value] [--codec TOLERANCE]\n"
+            "          [--workers N] [--worker-id K] [--lock-timeout SECONDS] [--verify]\n", program);
+}
+
+int main(int argc, char** argv) {
+    Bake_Config config;
+    config.tiles_x = 8;
+    config.tiles_z = 8;
+    config.params.tile_size = 256;
+    config.params.scale = 64.0f;
+    config.params.octaves = 6;
+    config.params.persistence = 0.5f;
+    config.params.backend = PERLIN_NOISE;
+    config.tolerance = 0.0f;
+    config.workers = 1;
+    config.worker_id = -1;
+    config.lock_timeout = DEFAULT_LOCK_TIMEOUT;
+    config.verify = false;
+
+    unsigned int given = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--out" && has_value) config.out_dir = argv[++i];
+        else if (arg == "--tiles" && i + 2 < argc) {
+            config.tiles_x = atoi(argv[++i]);
+            config.tiles_z = atoi(argv[++i]);
+            given |= FIELD_TILES;
+        }
+        else if (arg == "--tile-size" && has_value) { config.params.tile_size = atoi(argv[++i]); given |= FIELD_TILE_SIZE; }
+        else if (arg == "--scale" && has_value) { config.params.scale = (float)atof(argv[++i]); given |= FIELD_SCALE; }
+        else if (arg == "--octaves" && has_value) { config.params.octaves = atoi(argv[++i]); given |= FIELD_OCTAVES; }
+        else if (arg == "--persistence" && has_value) { config.params.persistence = (float)atof(argv[++i]); given |= FIELD_PERSISTENCE; }
+        else if (arg == "--backend" && has_value) {
+            if (!parse_backend(argv[++i], config.params.backend)) {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            given |= FIELD_BACKEND;
+        }
+        else if (arg == "--codec" && has_value) { config.tolerance = (float)atof(argv[++i]); given |= FIELD_TOLERANCE; }
+        else if (arg == "--workers" && has_value) config.workers = atoi(argv[++i]);
+        else if (arg == "--worker-id" && has_value) config.worker_id = atoi(argv[++i]);
+        else if (arg == "--lock-timeout" && has_value) config.lock_timeout = atoi(argv[++i]);
+        else if (arg == "--verify") config.verify = true;
+        else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (config.out_dir.empty() || config.tiles_x <= 0 || config.tiles_z <= 0 || config.params.tile_size <= 0
+        || config.params.scale <= 0.0f || config.params.octaves <= 0 || config.tolerance < 0.0f || config.workers <= 0 || config.lock_timeout <= 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!ensure_manifest(config, given)) return EXIT_FAILURE;
+
+    if (config.verify) return verify_tiles(config);
+    if (config.worker_id >= 0 || config.workers == 1) return run_worker(config);
+    return launch_workers(config, argc, argv);
+}